@@ -0,0 +1,126 @@
+// Per-message cost of MessageQueue against the concurrent_channel setup it replaced.
+// Producers run on their own threads and the consumer coroutine on another, the
+// way the portal and a telnet connection's writer do.
+
+#include <volcano/net/MessageQueue.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/concurrent_channel.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Channel = boost::asio::experimental::concurrent_channel<void(boost::system::error_code, std::string)>;
+
+    const std::string payload(64, 'x');
+
+    void report(const char* name, std::size_t producers, std::size_t total, std::chrono::steady_clock::duration elapsed) {
+        const double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        std::printf("%-16s %9zu %12zu %10.1f\n", name, producers, total, ns / static_cast<double>(total));
+    }
+
+    void run_queue(std::size_t producers, std::size_t per_producer) {
+        boost::asio::io_context consumer_ctx;
+        volcano::net::MessageQueue<std::string> queue(consumer_ctx.get_executor());
+        const std::size_t total = producers * per_producer;
+        std::size_t received = 0;
+
+        boost::asio::co_spawn(consumer_ctx, [&]() -> boost::asio::awaitable<void> {
+            while(received < total) {
+                auto msg = co_await queue.receive();
+                if(!msg) {
+                    co_return;
+                }
+                ++received;
+            }
+        }, boost::asio::detached);
+
+        const auto started = std::chrono::steady_clock::now();
+        std::thread consumer([&] { consumer_ctx.run(); });
+        std::vector<std::thread> threads;
+        for(std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&] {
+                for(std::size_t i = 0; i < per_producer; ++i) {
+                    queue.push(payload);
+                }
+            });
+        }
+        for(auto& t : threads) {
+            t.join();
+        }
+        consumer.join();
+        report("message_queue", producers, received, std::chrono::steady_clock::now() - started);
+    }
+
+    // to_telnet channel -> bridge coroutine -> outgoing channel -> writer, as before.
+    void run_channels(std::size_t producers, std::size_t per_producer) {
+        boost::asio::io_context consumer_ctx;
+        Channel to_telnet(consumer_ctx.get_executor(), 100);
+        Channel outgoing(consumer_ctx.get_executor(), 100);
+        const std::size_t total = producers * per_producer;
+        std::size_t received = 0;
+
+        boost::asio::co_spawn(consumer_ctx, [&]() -> boost::asio::awaitable<void> {
+            for(std::size_t i = 0; i < total; ++i) {
+                boost::system::error_code ec;
+                auto msg = co_await to_telnet.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                if(ec) {
+                    co_return;
+                }
+                co_await outgoing.async_send(ec, std::move(msg), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            }
+        }, boost::asio::detached);
+
+        boost::asio::co_spawn(consumer_ctx, [&]() -> boost::asio::awaitable<void> {
+            while(received < total) {
+                boost::system::error_code ec;
+                co_await outgoing.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                if(ec) {
+                    co_return;
+                }
+                ++received;
+            }
+        }, boost::asio::detached);
+
+        const auto started = std::chrono::steady_clock::now();
+        std::thread consumer([&] { consumer_ctx.run(); });
+        std::vector<std::thread> threads;
+        for(std::size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&] {
+                boost::asio::io_context producer_ctx;
+                boost::asio::co_spawn(producer_ctx, [&]() -> boost::asio::awaitable<void> {
+                    for(std::size_t i = 0; i < per_producer; ++i) {
+                        boost::system::error_code ec;
+                        co_await to_telnet.async_send(ec, payload, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                    }
+                }, boost::asio::detached);
+                producer_ctx.run();
+            });
+        }
+        for(auto& t : threads) {
+            t.join();
+        }
+        consumer.join();
+        report("channel+bridge", producers, received, std::chrono::steady_clock::now() - started);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t per_producer = 500000;
+    if(argc > 1) {
+        per_producer = std::stoul(argv[1]);
+    }
+
+    std::printf("%-16s %9s %12s %10s\n", "path", "producers", "messages", "ns/msg");
+    for(std::size_t producers : {1, 4}) {
+        run_channels(producers, per_producer);
+        run_queue(producers, per_producer);
+    }
+    return 0;
+}
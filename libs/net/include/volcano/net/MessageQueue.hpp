@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/associated_cancellation_slot.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace volcano::net {
+
+    // Unbounded multi-producer, single-consumer queue.
+    // push() is lock-free and callable from any thread; producers link a node onto
+    // an atomic stack and, if the consumer is parked, post its completion to the
+    // consumer's executor. The consumer takes the whole stack with one exchange
+    // and reverses it, so messages come out in push order.
+    // Only one receive()/async_wait() may be outstanding at a time.
+    template<typename T>
+    class MessageQueue {
+        public:
+        explicit MessageQueue(boost::asio::any_io_executor executor)
+            : executor_(std::move(executor)) {}
+
+        MessageQueue(const MessageQueue&) = delete;
+        MessageQueue& operator=(const MessageQueue&) = delete;
+
+        ~MessageQueue() {
+            free_list(head_.exchange(nullptr, std::memory_order_acquire));
+            free_list(pending_);
+        }
+
+        const boost::asio::any_io_executor& get_executor() const {
+            return executor_;
+        }
+
+        // Returns false (and drops the value) if the queue has been closed.
+        bool push(T value) {
+            if(closed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            auto* node = new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+            while(!head_.compare_exchange_weak(node->next, node, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            }
+            if(waiting_.load(std::memory_order_seq_cst)) {
+                wake({});
+            }
+            return true;
+        }
+
+        // Wakes the consumer. Messages already queued can still be received.
+        void close() {
+            closed_.store(true, std::memory_order_seq_cst);
+            wake({});
+        }
+
+        bool is_closed() const {
+            return closed_.load(std::memory_order_acquire);
+        }
+
+        // Consumer only.
+        std::optional<T> try_pop() {
+            if(!pending_) {
+                Node* batch = head_.exchange(nullptr, std::memory_order_acquire);
+                while(batch) {
+                    Node* next = batch->next;
+                    batch->next = pending_;
+                    pending_ = batch;
+                    batch = next;
+                }
+            }
+            if(!pending_) {
+                return std::nullopt;
+            }
+            std::unique_ptr<Node> node(pending_);
+            pending_ = node->next;
+            return std::optional<T>(std::move(node->value));
+        }
+
+        // Consumer only. Completes once a message is available, the queue is closed,
+        // or the handler's cancellation slot fires (operation_aborted).
+        template<typename CompletionToken>
+        auto async_wait(CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+                [this](auto handler) {
+                    auto slot = boost::asio::get_associated_cancellation_slot(handler);
+                    if(slot.is_connected()) {
+                        slot.assign([this](boost::asio::cancellation_type) {
+                            wake(boost::asio::error::operation_aborted);
+                        });
+                    }
+                    auto executor = boost::asio::get_associated_executor(handler, executor_);
+                    waiter_ = [handler = std::move(handler), executor](boost::system::error_code ec) mutable {
+                        boost::asio::post(executor, [handler = std::move(handler), ec]() mutable {
+                            boost::asio::get_associated_cancellation_slot(handler).clear();
+                            std::move(handler)(ec);
+                        });
+                    };
+
+                    // a producer that pushed before seeing waiting_ is caught by the re-check.
+                    waiting_.store(true, std::memory_order_seq_cst);
+                    if(pending_ || head_.load(std::memory_order_seq_cst) || closed_.load(std::memory_order_seq_cst)) {
+                        wake({});
+                    }
+                },
+                token);
+        }
+
+        // Consumer only. Returns the next message, eof once the queue is closed and
+        // drained, or operation_aborted if the slot is cancelled.
+        boost::asio::awaitable<std::expected<T, boost::system::error_code>> receive(boost::asio::cancellation_slot slot = {}) {
+            for(;;) {
+                if(auto value = try_pop()) {
+                    co_return std::move(*value);
+                }
+                if(is_closed()) {
+                    co_return std::unexpected(boost::system::error_code(boost::asio::error::eof));
+                }
+
+                boost::system::error_code ec;
+                co_await async_wait(boost::asio::bind_cancellation_slot(
+                    slot, boost::asio::redirect_error(boost::asio::use_awaitable, ec)));
+                if(ec) {
+                    co_return std::unexpected(ec);
+                }
+            }
+        }
+
+        private:
+        struct Node {
+            T value;
+            Node* next;
+        };
+
+        static void free_list(Node* node) {
+            while(node) {
+                std::unique_ptr<Node> owned(node);
+                node = node->next;
+            }
+        }
+
+        // whoever flips waiting_ back to false owns the parked waiter and completes it.
+        void wake(boost::system::error_code ec) {
+            bool expected = true;
+            if(!waiting_.compare_exchange_strong(expected, false, std::memory_order_acq_rel)) {
+                return;
+            }
+            auto waiter = std::move(waiter_);
+            waiter_ = nullptr;
+            waiter(ec);
+        }
+
+        boost::asio::any_io_executor executor_;
+        std::atomic<Node*> head_{nullptr};
+        std::atomic<bool> waiting_{false};
+        std::atomic<bool> closed_{false};
+        Node* pending_{nullptr};
+        std::move_only_function<void(boost::system::error_code)> waiter_;
+    };
+
+}
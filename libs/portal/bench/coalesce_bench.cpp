@@ -0,0 +1,150 @@
+// Runs request coalescing against a portal-built request: a loopback backend counts
+// the requests that reach it while many clients ask for the same who-list at once.
+// Client::createSharedRequest GETs should cost the backend one request per burst;
+// the same GET with a per-player X-Forwarded-For, as createBaseRequest builds it,
+// can't be shared and costs one each. Exits with 2 if the shared burst isn't
+// coalesced.
+//
+//   volcano_portal_coalesce_bench [clients]
+
+#include <volcano/net/Base.hpp>
+#include <volcano/portal/Client.hpp>
+#include <volcano/web/HttpClient.hpp>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace {
+
+    namespace http = boost::beast::http;
+    using boost::asio::awaitable;
+    using boost::asio::use_awaitable;
+
+    std::size_t backend_requests = 0;
+
+    // answers every request after a short delay, long enough for a burst to pile up behind it.
+    awaitable<void> serve(boost::asio::ip::tcp::socket socket) {
+        boost::beast::flat_buffer buffer;
+        for (;;) {
+            boost::system::error_code ec;
+            http::request<http::string_body> req;
+            co_await http::async_read(socket, buffer, req, boost::asio::redirect_error(use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+            ++backend_requests;
+
+            boost::asio::steady_timer delay(socket.get_executor(), std::chrono::milliseconds(20));
+            co_await delay.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+
+            http::response<http::string_body> res{http::status::ok, req.version()};
+            res.set(http::field::content_type, "text/plain");
+            res.body() = "3 players online";
+            res.keep_alive(req.keep_alive());
+            res.prepare_payload();
+            co_await http::async_write(socket, res, boost::asio::redirect_error(use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+        }
+    }
+
+    awaitable<void> accept_loop(boost::asio::ip::tcp::acceptor& acceptor) {
+        for (;;) {
+            boost::system::error_code ec;
+            auto socket = co_await acceptor.async_accept(boost::asio::redirect_error(use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+            boost::asio::co_spawn(acceptor.get_executor(), serve(std::move(socket)), boost::asio::detached);
+        }
+    }
+
+    // fires `clients` identical requests at once and returns how many reached the backend.
+    awaitable<std::size_t> burst(volcano::web::HttpClient& client, std::size_t clients,
+        const std::function<volcano::web::HttpRequest(std::size_t)>& make) {
+        const auto before = backend_requests;
+        std::size_t pending = clients;
+        std::size_t failed = 0;
+        boost::asio::steady_timer done(co_await boost::asio::this_coro::executor, std::chrono::steady_clock::time_point::max());
+
+        for (std::size_t i = 0; i < clients; ++i) {
+            boost::asio::co_spawn(volcano::net::context(), [&, req = make(i)]() mutable -> awaitable<void> {
+                auto response = co_await client.request(std::move(req));
+                if (!response || response->body() != "3 players online") {
+                    ++failed;
+                }
+                if (--pending == 0) {
+                    done.cancel();
+                }
+            }, boost::asio::detached);
+        }
+        boost::system::error_code ec;
+        co_await done.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        if (failed) {
+            std::fprintf(stderr, "%zu requests failed\n", failed);
+        }
+        co_return backend_requests - before;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t clients = 200;
+    if (argc > 1) {
+        clients = std::stoul(argv[1]);
+    }
+
+    auto& ctx = volcano::net::context();
+    boost::asio::ip::tcp::acceptor acceptor(ctx, {boost::asio::ip::address_v4::loopback(), 0});
+    boost::asio::co_spawn(ctx, accept_loop(acceptor), boost::asio::detached);
+
+    volcano::portal::target.address = boost::asio::ip::address_v4::loopback();
+    volcano::portal::target.port = acceptor.local_endpoint().port();
+    volcano::web::request_coalescing_options.enabled = true;
+
+    int status = 0;
+    boost::asio::co_spawn(ctx, [&]() -> awaitable<void> {
+        volcano::web::HttpClient client(volcano::portal::target, volcano::web::HttpPoolOptions{.max_sessions = clients});
+
+        auto shared = [](std::size_t) {
+            return volcano::portal::Client::createSharedRequest("/who");
+        };
+        auto per_player = [](std::size_t i) {
+            auto req = volcano::portal::Client::createSharedRequest("/who");
+            req.set(http::field::x_forwarded_for, "198.51.100." + std::to_string(i % 250));
+            return req;
+        };
+
+        std::printf("shared request coalescable      %s\n", volcano::web::request_is_coalescable(shared(0)) ? "yes" : "no");
+        std::printf("per-player request coalescable  %s\n", volcano::web::request_is_coalescable(per_player(0)) ? "yes" : "no");
+
+        const auto shared_hits = co_await burst(client, clients, shared);
+        const auto player_hits = co_await burst(client, clients, per_player);
+        std::printf("%zu shared GETs      -> %zu backend requests\n", clients, shared_hits);
+        std::printf("%zu per-player GETs  -> %zu backend requests\n", clients, player_hits);
+
+        const auto stats = volcano::web::request_coalescing_stats();
+        std::printf("coalescing: %llu requests, %llu fetched, %llu coalesced\n",
+            static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.fetched),
+            static_cast<unsigned long long>(stats.coalesced));
+
+        if (shared_hits != 1) {
+            status = 2;
+        }
+        acceptor.close();
+        ctx.stop();
+    }, boost::asio::detached);
+
+    ctx.run();
+    return status;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "volcano/telnet/Base.hpp"
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace volcano::portal {
+
+    // The parts of ClientData that change how text is rendered.
+    struct RenderVariant {
+        uint8_t color{0};
+        uint16_t width{78};
+
+        auto operator<=>(const RenderVariant&) const = default;
+    };
+
+    // Renders a broadcast for one variant. Called at most once per distinct variant
+    // among the recipients, outside of any lock.
+    using BroadcastRenderer = std::function<std::string(const RenderVariant& variant)>;
+    // An empty filter matches every registered client.
+    using BroadcastFilter = std::function<bool(const volcano::mud::ClientData& data)>;
+
+    // Every portal Client registers its link here for the lifetime of the client.
+    // The registry keeps its own copy of ClientData, refreshed by Client::changeCapabilities,
+    // so filters never race the connection that owns the link.
+    void register_broadcast_link(std::shared_ptr<volcano::telnet::TelnetLink> link);
+    void update_broadcast_link(std::int64_t connection_id, const volcano::mud::ClientData& data);
+    void unregister_broadcast_link(std::int64_t connection_id);
+
+    // Renders the text once per variant and transcodes and IAC-escapes it once per
+    // (variant, charset); every recipient with that pair is queued the same wire
+    // buffer, and only MCCP runs per connection. Returns the number of connections
+    // the message was queued to.
+    //
+    // Broadcasts never wait on a recipient, so SlowClientPolicy::block doesn't hold
+    // one up: waiting for each slow client in turn would delay everyone after it.
+    // Instead OutputLimits::hard_limit applies under every policy, block included:
+    // a recipient whose queue is already that full is skipped and not counted.
+    std::size_t broadcast(std::span<const std::int64_t> connection_ids, const BroadcastRenderer& render);
+    std::size_t broadcast(const BroadcastFilter& filter, const BroadcastRenderer& render);
+
+    // Text that looks the same for everyone is copied once and shared by all recipients.
+    std::size_t broadcast(std::span<const std::int64_t> connection_ids, std::string_view text);
+    std::size_t broadcast(const BroadcastFilter& filter, std::string_view text);
+
+    // GMCP only goes to recipients that negotiated it.
+    std::size_t broadcastGMCP(const BroadcastFilter& filter, std::shared_ptr<const volcano::telnet::PreparedGMCP> prepared);
+}
@@ -9,6 +9,8 @@
 #include <boost/asio/experimental/concurrent_channel.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -29,7 +31,7 @@ namespace volcano::portal {
         virtual ~ModeHandler() = default;
 
         boost::asio::awaitable<void> run();
-        void requestCancel();
+        virtual void requestCancel();
 
         protected:
 
@@ -38,7 +40,8 @@ namespace volcano::portal {
 
         boost::asio::awaitable<void> runTelnetReader();
         virtual boost::asio::awaitable<void> handleCommand(const std::string& data);
-        virtual boost::asio::awaitable<void> handleGMCP(const std::string& package, const nlohmann::json& data);
+        // gmcp.data() parses the body; handlers that ignore a package never pay for it.
+        virtual boost::asio::awaitable<void> handleGMCP(const volcano::telnet::TelnetReceivedGMCP& gmcp);
         virtual boost::asio::awaitable<void> handleDisconnect();
         virtual boost::asio::awaitable<void> handleChangeCapabilities(const nlohmann::json& j);
 
@@ -58,21 +61,34 @@ namespace volcano::portal {
         boost::asio::steady_timer::duration expires_in;
     };
 
+    struct RefreshOptions {
+        // Every client's refresh deadline sits on one shared timer. When it fires,
+        // deadlines falling within batch_window after it are refreshed in the same pass.
+        boost::asio::steady_timer::duration batch_window{std::chrono::seconds(5)};
+    };
+
+    extern RefreshOptions refresh_options;
+
     class Client {
         public:
         explicit Client(std::shared_ptr<volcano::telnet::TelnetLink> link);
+        ~Client();
 
         boost::asio::awaitable<void> run();
 
         boost::asio::awaitable<void> handleTelnetDisconnect();
-        boost::asio::awaitable<void> sendText(const std::string& text);
-        boost::asio::awaitable<void> sendLine(const std::string& text);
+        boost::asio::awaitable<void> sendText(std::string text);
+        // shared output is queued by reference, so one render can go to many clients.
+        boost::asio::awaitable<void> sendText(std::shared_ptr<const std::string> text);
+        boost::asio::awaitable<void> sendLine(std::string text);
         boost::asio::awaitable<void> sendGMCP(const std::string& package, const nlohmann::json& data);
+        // built once with volcano::telnet::prepareGMCP and reused across sends and clients.
+        boost::asio::awaitable<void> sendGMCP(std::shared_ptr<const volcano::telnet::PreparedGMCP> prepared);
         boost::asio::awaitable<void> sendMSSP(const std::vector<std::pair<std::string, std::string>>& mssp_data);
         boost::asio::awaitable<void> sendDisconnect();
 
         boost::asio::awaitable<void> enqueueMode(std::shared_ptr<ModeHandler> next);
-        volcano::telnet::Channel<volcano::telnet::TelnetToGameMessage>& telnetToGameChannel();
+        volcano::telnet::ToGameQueue& telnetToGameQueue();
 
         Channel<std::shared_ptr<ModeHandler>> mode_handler_channel_;
         boost::asio::awaitable<void> changeCapabilities(const nlohmann::json& j);
@@ -81,11 +97,22 @@ namespace volcano::portal {
             return http_client_;
         }
 
+        // A GET for data that is the same for every player (who list, MOTD, status). It
+        // carries no Authorization or X-Forwarded-For and names the backend as Host, so
+        // HttpClient can coalesce and cache it across clients.
+        static volcano::web::HttpRequest createSharedRequest(const std::string& target_path);
+
         volcano::web::HttpRequest createBaseRequest(boost::beast::http::verb method, const std::string& target_path);
         volcano::web::HttpRequest createAuthenticatedRequest(boost::beast::http::verb method, const std::string& target_path);
         volcano::web::HttpRequest createJsonRequest(boost::beast::http::verb method, const std::string& target_path, const nlohmann::json& j);
 
-        std::optional<JwtTokens> tokens;
+        const std::optional<JwtTokens>& tokens() const {
+            return tokens_;
+        }
+
+        // Replaces the tokens and wakes the refresher, which schedules the next refresh
+        // (or drops it, for std::nullopt).
+        void setTokens(std::optional<JwtTokens> tokens);
 
         volcano::mud::ClientData& clientData() {
             return link_->client_data;
@@ -102,7 +129,13 @@ namespace volcano::portal {
         private:
         boost::asio::cancellation_signal cancellation_signal_;
         boost::asio::cancellation_state cancellation_state_;
-        boost::asio::steady_timer refresh_timer_;
+        // written by setTokens and the shared refresh scheduler; runRefresher only wakes for these.
+        // carries 0 when the tokens changed, or the token generation whose refresh is due.
+        std::shared_ptr<Channel<std::uint64_t>> refresh_signal_;
+        std::optional<JwtTokens> tokens_;
+        // bumped by setTokens, starting from 1, so due signals for replaced tokens can be told apart.
+        std::uint64_t token_generation_{1};
+        boost::asio::steady_timer::time_point refresh_at_;
         std::shared_ptr<volcano::telnet::TelnetLink> link_;
         volcano::web::ClientInfo client_info_;
         volcano::web::HttpClient http_client_;
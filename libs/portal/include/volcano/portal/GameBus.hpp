@@ -0,0 +1,181 @@
+#pragma once
+#include "volcano/portal/Client.hpp"
+#include "volcano/web/BodyFormat.hpp"
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/cancellation_signal.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace volcano::portal {
+
+    // The game bus is one WebSocket from the portal process to the game, at
+    // game_bus_options.path on portal::target, carrying every session at once.
+    // Each message is a map tagged with its type ("t") and session ("s"):
+    //
+    //   portal -> game   open {info, credits}, close, cmd {d}, gmcp {p, d}, credit {n}
+    //   game -> portal   text {d}, gmcp {p, d}, disconnect, credit {n}
+    //
+    // Flow control is per session: a side may send as many frames for a session as
+    // the other has granted (the open's credits to start, then "credit" frames), so
+    // one slow client never holds up the others. After a reconnect every live
+    // session is re-opened, granting only what the portal still has room for; the
+    // game should treat a repeated open as a resume, with a fresh window of its own.
+    // Commands and closes that were queued when the connection dropped go out after
+    // the re-opens; stale opens and credits are superseded by them. A session the
+    // game knew before the drop that is neither re-opened nor closed is gone.
+    struct GameBusOptions {
+        std::string path{"/portal/bus"};
+        // sent as a bearer token on the upgrade request, if set.
+        std::string token;
+        volcano::web::BodyFormat format{volcano::web::BodyFormat::cbor};
+        // frames each side may send per session before the other grants more.
+        int credits{64};
+        // frames from all sessions waiting for the writer.
+        std::size_t outbound_queue{1024};
+        std::chrono::steady_clock::duration reconnect_delay{std::chrono::seconds(2)};
+    };
+
+    extern GameBusOptions game_bus_options;
+
+    // Something the game sent to one session.
+    struct BusEvent {
+        enum class Kind {
+            text,
+            gmcp,
+            disconnect
+        };
+
+        Kind kind{Kind::text};
+        // the text, or the GMCP package.
+        std::string text;
+        nlohmann::json data;
+    };
+
+    class GameBus;
+
+    class BusSession {
+        public:
+        BusSession(GameBus& bus, std::int64_t id, nlohmann::json info);
+
+        std::int64_t id() const {
+            return id_;
+        }
+
+        // Both wait for a send credit first. False once the session is closed.
+        boost::asio::awaitable<bool> sendCommand(std::string command, boost::asio::cancellation_slot slot = {});
+        boost::asio::awaitable<bool> sendGMCP(std::string package, nlohmann::json data, boost::asio::cancellation_slot slot = {});
+
+        // Next event from the game; std::nullopt once closed or cancelled.
+        boost::asio::awaitable<std::optional<BusEvent>> receive(boost::asio::cancellation_slot slot = {});
+
+        // Call once an event has been handed to the client; credit goes back to the
+        // game in batches of half the window.
+        boost::asio::awaitable<void> consumed();
+
+        boost::asio::awaitable<void> close();
+
+        private:
+        friend class GameBus;
+
+        boost::asio::awaitable<bool> sendFrame(nlohmann::json frame, boost::asio::cancellation_slot slot);
+        // grants the game what inbound_ still has room for.
+        nlohmann::json openFrame();
+        void deliver(BusEvent event);
+        void grant(int credits);
+        // withdraws the send credits until reset().
+        void freeze();
+        // replayed: commands from before the reconnect that will be resent under the new window.
+        void reset(int replayed);
+
+        GameBus& bus_;
+        std::int64_t id_;
+        nlohmann::json info_;
+        std::atomic<int> send_credits_;
+        std::atomic<int> unacknowledged_{0};
+        // events delivered but not yet received by the mode.
+        std::atomic<int> queued_{0};
+        std::atomic<bool> closed_{false};
+        Channel<bool> credit_signal_;
+        Channel<BusEvent> inbound_;
+    };
+
+    class GameBus {
+        public:
+        GameBus();
+
+        // Registers a session and tells the game about it. Connects the bus on first use.
+        boost::asio::awaitable<std::shared_ptr<BusSession>> open(std::int64_t id, nlohmann::json info);
+
+        bool connected() const {
+            return connected_.load(std::memory_order_relaxed);
+        }
+
+        private:
+        friend class BusSession;
+
+        struct OutboundFrame {
+            enum class Kind {
+                // cmd and gmcp: spent a send credit, resent after a reconnect.
+                command,
+                // open and credit: superseded by the re-open after a reconnect.
+                control,
+                close
+            };
+
+            std::int64_t session{0};
+            Kind kind{Kind::control};
+            std::string bytes;
+        };
+
+        boost::asio::awaitable<void> run();
+        boost::asio::awaitable<std::optional<volcano::web::WebSocketStream>> connect();
+        boost::asio::awaitable<void> readLoop(volcano::web::WebSocketStream& ws);
+        boost::asio::awaitable<void> writeLoop(volcano::web::WebSocketStream& ws);
+        void dispatch(const nlohmann::json& frame);
+        boost::asio::awaitable<bool> send(std::int64_t session, const nlohmann::json& frame,
+                                          OutboundFrame::Kind kind = OutboundFrame::Kind::control);
+        void forget(std::int64_t id);
+
+        std::mutex mutex_;
+        std::unordered_map<std::int64_t, std::weak_ptr<BusSession>> sessions_;
+        bool running_{false};
+        std::atomic<bool> connected_{false};
+        Channel<OutboundFrame> outbound_;
+        // frames held over to the next connection, oldest first; the writer's strand only.
+        std::vector<OutboundFrame> unsent_;
+    };
+
+    GameBus& game_bus();
+
+    // Hands the client to the game over the bus: commands and GMCP go out as frames
+    // instead of one HTTP call each, and game output is pushed back as it happens.
+    class GameBusMode : public ModeHandler {
+        public:
+        using ModeHandler::ModeHandler;
+
+        void requestCancel() override;
+
+        protected:
+        // What the game receives in the open frame.
+        virtual nlohmann::json sessionInfo();
+
+        boost::asio::awaitable<void> enterMode() override;
+        boost::asio::awaitable<void> exitMode() override;
+        boost::asio::awaitable<void> runImpl() override;
+        boost::asio::awaitable<void> handleCommand(const std::string& data) override;
+        boost::asio::awaitable<void> handleGMCP(const volcano::telnet::TelnetReceivedGMCP& gmcp) override;
+
+        std::shared_ptr<BusSession> session_;
+        // runTelnetReader holds the base cancellation slot, so the event pump gets its own.
+        boost::asio::cancellation_signal events_cancel_;
+    };
+}
@@ -3,6 +3,7 @@
 #include <string>
 #include <string_view>
 
+#include "Broadcast.hpp"
 #include "Client.hpp"
 
 namespace volcano::portal {
@@ -0,0 +1,178 @@
+#include "volcano/portal/Broadcast.hpp"
+#include "volcano/log/Log.hpp"
+#include "volcano/telnet/OutgoingQueue.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace volcano::portal {
+
+    namespace {
+        struct BroadcastEntry {
+            std::shared_ptr<volcano::telnet::TelnetLink> link;
+            volcano::mud::ClientData data;
+        };
+
+        struct Recipient {
+            std::shared_ptr<volcano::telnet::TelnetLink> link;
+            RenderVariant variant;
+            volcano::telnet::Charset charset{volcano::telnet::Charset::utf8};
+        };
+
+        std::mutex registry_mutex;
+        std::unordered_map<std::int64_t, BroadcastEntry> registry;
+
+        RenderVariant variant_of(const volcano::mud::ClientData& data) {
+            return RenderVariant{.color = data.color, .width = data.width};
+        }
+
+        Recipient recipient_of(const BroadcastEntry& entry) {
+            const auto charset = entry.link->to_telnet ? entry.link->to_telnet->charset() : volcano::telnet::Charset::utf8;
+            return Recipient{entry.link, variant_of(entry.data), charset};
+        }
+
+        // snapshot the matching links so rendering and queueing happen without the lock.
+        template<typename Match>
+        std::vector<Recipient> collect(Match&& match) {
+            std::vector<Recipient> out;
+            std::lock_guard lock(registry_mutex);
+            out.reserve(registry.size());
+            for (const auto& [id, entry] : registry) {
+                if (match(entry.data)) {
+                    out.push_back(recipient_of(entry));
+                }
+            }
+            return out;
+        }
+
+        std::vector<Recipient> collect_ids(std::span<const std::int64_t> connection_ids) {
+            std::vector<Recipient> out;
+            out.reserve(connection_ids.size());
+            std::lock_guard lock(registry_mutex);
+            for (auto id : connection_ids) {
+                if (auto found = registry.find(id); found != registry.end()) {
+                    out.push_back(recipient_of(found->second));
+                }
+            }
+            return out;
+        }
+
+        auto everyone_or(const BroadcastFilter& filter) {
+            return [&filter](const volcano::mud::ClientData& data) {
+                return !filter || filter(data);
+            };
+        }
+
+        // try_send(), not async_send(): see broadcast() for why slow recipients aren't waited on.
+        std::size_t deliver(const Recipient& recipient, volcano::telnet::TelnetToTelnetMessage msg) {
+            if (recipient.link->try_send(std::move(msg)) != volcano::telnet::PushResult::queued) {
+                LTRACE("Broadcast skipped {}: link closed or output full", *recipient.link);
+                return 0;
+            }
+            return 1;
+        }
+
+        // text as it goes on the wire for charset; shares text itself when encoding changes nothing.
+        std::shared_ptr<const std::string> encode_wire(const std::shared_ptr<const std::string>& text, volcano::telnet::Charset charset) {
+            std::string scratch;
+            const auto wire = volcano::telnet::encode_app_data(charset, *text, scratch);
+            if (wire.data() == text->data()) {
+                return text;
+            }
+            return std::make_shared<const std::string>(std::move(scratch));
+        }
+
+        volcano::telnet::TelnetMessageWire wire_message(const std::shared_ptr<const std::string>& text,
+            std::shared_ptr<const std::string>& wire, volcano::telnet::Charset charset) {
+            if (!wire) {
+                wire = encode_wire(text, charset);
+            }
+            return volcano::telnet::TelnetMessageWire{text, wire, charset};
+        }
+
+        std::size_t send_rendered(const std::vector<Recipient>& recipients, const BroadcastRenderer& render) {
+            // a broadcast rarely spans more than a handful of variants and charsets.
+            std::map<RenderVariant, std::shared_ptr<const std::string>> rendered;
+            std::map<std::pair<RenderVariant, volcano::telnet::Charset>, std::shared_ptr<const std::string>> encoded;
+            std::size_t sent = 0;
+            for (const auto& recipient : recipients) {
+                auto& text = rendered[recipient.variant];
+                if (!text) {
+                    text = std::make_shared<const std::string>(render(recipient.variant));
+                }
+                auto& wire = encoded[{recipient.variant, recipient.charset}];
+                sent += deliver(recipient, wire_message(text, wire, recipient.charset));
+            }
+            return sent;
+        }
+
+        std::size_t send_shared(const std::vector<Recipient>& recipients, std::string_view text) {
+            if (recipients.empty()) {
+                return 0;
+            }
+            auto buffer = std::make_shared<const std::string>(text);
+            std::map<volcano::telnet::Charset, std::shared_ptr<const std::string>> encoded;
+            std::size_t sent = 0;
+            for (const auto& recipient : recipients) {
+                sent += deliver(recipient, wire_message(buffer, encoded[recipient.charset], recipient.charset));
+            }
+            return sent;
+        }
+    }
+
+    void register_broadcast_link(std::shared_ptr<volcano::telnet::TelnetLink> link) {
+        if (!link) {
+            return;
+        }
+        auto data = link->client_data;
+        const auto id = link->connection_id;
+        std::lock_guard lock(registry_mutex);
+        registry.insert_or_assign(id, BroadcastEntry{std::move(link), std::move(data)});
+    }
+
+    void update_broadcast_link(std::int64_t connection_id, const volcano::mud::ClientData& data) {
+        std::lock_guard lock(registry_mutex);
+        if (auto found = registry.find(connection_id); found != registry.end()) {
+            found->second.data = data;
+        }
+    }
+
+    void unregister_broadcast_link(std::int64_t connection_id) {
+        std::lock_guard lock(registry_mutex);
+        registry.erase(connection_id);
+    }
+
+    std::size_t broadcast(std::span<const std::int64_t> connection_ids, const BroadcastRenderer& render) {
+        return send_rendered(collect_ids(connection_ids), render);
+    }
+
+    std::size_t broadcast(const BroadcastFilter& filter, const BroadcastRenderer& render) {
+        return send_rendered(collect(everyone_or(filter)), render);
+    }
+
+    std::size_t broadcast(std::span<const std::int64_t> connection_ids, std::string_view text) {
+        return send_shared(collect_ids(connection_ids), text);
+    }
+
+    std::size_t broadcast(const BroadcastFilter& filter, std::string_view text) {
+        return send_shared(collect(everyone_or(filter)), text);
+    }
+
+    std::size_t broadcastGMCP(const BroadcastFilter& filter, std::shared_ptr<const volcano::telnet::PreparedGMCP> prepared) {
+        if (!prepared) {
+            return 0;
+        }
+        auto recipients = collect([&](const volcano::mud::ClientData& data) {
+            return data.gmcp && (!filter || filter(data));
+        });
+        std::size_t sent = 0;
+        for (const auto& recipient : recipients) {
+            sent += deliver(recipient, volcano::telnet::TelnetMessagePreparedGMCP{prepared});
+        }
+        return sent;
+    }
+}
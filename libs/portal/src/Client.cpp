@@ -1,6 +1,7 @@
 #include "volcano/net/net.hpp"
 #include "volcano/log/Log.hpp"
 #include "volcano/portal/Client.hpp"
+#include "volcano/portal/Broadcast.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/bind_cancellation_slot.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
@@ -8,12 +9,117 @@
 #include "volcano/mud/ClientDataSave.hpp"
 
 #include <chrono>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 
 namespace volcano::portal {
 
     volcano::web::HttpTarget target;
     std::function<std::shared_ptr<ModeHandler>(Client& client)> create_initial_mode_handler;
     std::function<boost::asio::awaitable<std::optional<JwtTokens>>(Client& client)> handle_refresh_timer;
+    RefreshOptions refresh_options;
+
+    namespace {
+        // One timer for every client's token refresh. Clients register a deadline and
+        // the channel their refresher waits on; when the deadline comes up (or falls
+        // within batch_window of it) the scheduler sends the token generation it was
+        // given and the client does the refresh itself.
+        class RefreshScheduler {
+            public:
+            using Clock = boost::asio::steady_timer::clock_type;
+
+            void schedule(const Client* client, Clock::time_point deadline, std::uint64_t generation, std::weak_ptr<Channel<std::uint64_t>> signal) {
+                std::lock_guard lock(mutex_);
+                erase_locked(client);
+                auto it = deadlines_.emplace(deadline, Entry{client, generation, std::move(signal)});
+                index_[client] = it;
+                if(!running_) {
+                    running_ = true;
+                    boost::asio::co_spawn(strand_, run(), boost::asio::detached);
+                } else if(it == deadlines_.begin()) {
+                    // sooner than what the timer is waiting for.
+                    boost::asio::post(strand_, [this] { timer_.cancel(); });
+                }
+            }
+
+            void cancel(const Client* client) {
+                std::lock_guard lock(mutex_);
+                erase_locked(client);
+            }
+
+            private:
+            struct Entry {
+                const Client* client;
+                std::uint64_t generation;
+                std::weak_ptr<Channel<std::uint64_t>> signal;
+            };
+            using Deadlines = std::multimap<Clock::time_point, Entry>;
+
+            void erase_locked(const Client* client) {
+                if(auto found = index_.find(client); found != index_.end()) {
+                    deadlines_.erase(found->second);
+                    index_.erase(found);
+                }
+            }
+
+            boost::asio::awaitable<void> run() {
+                for(;;) {
+                    {
+                        std::lock_guard lock(mutex_);
+                        if(deadlines_.empty()) {
+                            running_ = false;
+                            co_return;
+                        }
+                        timer_.expires_at(deadlines_.begin()->first);
+                    }
+                    boost::system::error_code ec;
+                    co_await timer_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                    fire_due();
+                }
+            }
+
+            void fire_due() {
+                std::vector<std::pair<std::shared_ptr<Channel<std::uint64_t>>, std::uint64_t>> due;
+                {
+                    std::lock_guard lock(mutex_);
+                    const auto horizon = Clock::now() + refresh_options.batch_window;
+                    while(!deadlines_.empty() && deadlines_.begin()->first <= horizon) {
+                        auto entry = deadlines_.begin();
+                        if(auto signal = entry->second.signal.lock()) {
+                            due.emplace_back(std::move(signal), entry->second.generation);
+                        }
+                        index_.erase(entry->second.client);
+                        deadlines_.erase(entry);
+                    }
+                }
+                for(auto& [signal, generation] : due) {
+                    signal->try_send(boost::system::error_code{}, generation);
+                }
+            }
+
+            std::mutex mutex_;
+            Deadlines deadlines_;
+            std::unordered_map<const Client*, Deadlines::iterator> index_;
+            bool running_{false};
+            boost::asio::strand<boost::asio::io_context::executor_type> strand_{boost::asio::make_strand(volcano::net::context())};
+            boost::asio::steady_timer timer_{strand_};
+        };
+
+        RefreshScheduler& refresh_scheduler() {
+            static RefreshScheduler scheduler;
+            return scheduler;
+        }
+
+        // a drop is the slow-client policy at work and is counted in output_queue_totals().
+        void report_send(const volcano::telnet::TelnetLink& link, volcano::telnet::PushResult result, std::string_view what) {
+            if (result == volcano::telnet::PushResult::closed) {
+                LERROR("Failed to send {} to telnet link {}: link closed", what, link);
+            } else if (result == volcano::telnet::PushResult::dropped) {
+                LDEBUG("Dropped {} for telnet link {}: output queue is full", what, link);
+            }
+        }
+    }
 
     ModeHandler::ModeHandler(Client& client)
         : client_(client),
@@ -59,26 +165,22 @@ namespace volcano::portal {
     }
 
     boost::asio::awaitable<void> ModeHandler::runTelnetReader() {
-        auto &chan = client_.telnetToGameChannel();
+        auto &queue = client_.telnetToGameQueue();
 
         for(;;) {
             if (cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
                 co_return;
             }
 
-            boost::system::error_code ec;
-            auto msg = co_await chan.async_receive(
-                boost::asio::bind_cancellation_slot(
-                    cancellation_state_.slot(),
-                    boost::asio::redirect_error(boost::asio::use_awaitable, ec))
-            );
+            auto received = co_await queue.receive(cancellation_state_.slot());
 
-            if(ec) {
+            if(!received) {
                 if (cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
                     co_return;
                 }
                 co_return;
             }
+            auto &msg = *received;
 
             if(std::holds_alternative<volcano::telnet::TelnetDisconnect>(msg)) {
                 co_await handleDisconnect();
@@ -90,9 +192,13 @@ namespace volcano::portal {
             if(std::holds_alternative<volcano::telnet::TelnetMessageData>(game_msg)) {
                 const auto &data_msg = std::get<volcano::telnet::TelnetMessageData>(game_msg);
                 co_await handleCommand(data_msg.data);
-            } else if(std::holds_alternative<volcano::telnet::TelnetMessageGMCP>(game_msg)) {
-                const auto &gmcp_msg = std::get<volcano::telnet::TelnetMessageGMCP>(game_msg);
-                co_await handleGMCP(gmcp_msg.package, gmcp_msg.data);
+            } else if(std::holds_alternative<volcano::telnet::TelnetMessageLines>(game_msg)) {
+                const auto &lines_msg = std::get<volcano::telnet::TelnetMessageLines>(game_msg);
+                for(const auto &line : lines_msg.lines) {
+                    co_await handleCommand(line);
+                }
+            } else if(std::holds_alternative<volcano::telnet::TelnetReceivedGMCP>(game_msg)) {
+                co_await handleGMCP(std::get<volcano::telnet::TelnetReceivedGMCP>(game_msg));
             } else if(std::holds_alternative<volcano::telnet::TelnetChangeCapabilities>(game_msg)) {
                 const auto &cap_msg = std::get<volcano::telnet::TelnetChangeCapabilities>(game_msg);
                 co_await client_.changeCapabilities(cap_msg.capabilities);
@@ -105,7 +211,7 @@ namespace volcano::portal {
         co_return;
     }
 
-    boost::asio::awaitable<void> ModeHandler::handleGMCP(const std::string& package, const nlohmann::json& data) {
+    boost::asio::awaitable<void> ModeHandler::handleGMCP(const volcano::telnet::TelnetReceivedGMCP& gmcp) {
         co_return;
     }
 
@@ -121,13 +227,22 @@ namespace volcano::portal {
     Client::Client(std::shared_ptr<volcano::telnet::TelnetLink> link)
     : link_(std::move(link)), 
     mode_handler_channel_(volcano::net::context(), 2), 
-    http_client_(target), 
-    refresh_timer_(volcano::net::context()),
+    http_client_(volcano::web::shared_session_pools().pool_for(target)), 
+    refresh_signal_(std::make_shared<Channel<std::uint64_t>>(volcano::net::context(), 1)),
     cancellation_state_(cancellation_signal_.slot())
     {
         if (link_) {
             client_info_.address = link_->address;
             client_info_.hostname = link_->hostname;
+            register_broadcast_link(link_);
+        }
+    }
+
+    Client::~Client()
+    {
+        refresh_scheduler().cancel(this);
+        if (link_) {
+            unregister_broadcast_link(link_->connection_id);
         }
     }
 
@@ -135,14 +250,24 @@ namespace volcano::portal {
     {
         volcano::web::HttpRequest req{method, target_path, 11};
         req.set(boost::beast::http::field::host, client_info_.hostname);
-        if(tokens) {
-            req.set(boost::beast::http::field::authorization, "Bearer " + tokens->jwt);
+        if(tokens_) {
+            req.set(boost::beast::http::field::authorization, "Bearer " + tokens_->jwt);
         }
         req.set(boost::beast::http::field::user_agent, "volcano-portal/1.0");
+        req.set(boost::beast::http::field::accept, volcano::web::accept_for(volcano::web::body_format_options.responses));
         req.set(boost::beast::http::field::x_forwarded_for, link_->address.to_string());
         return req;
     }
 
+    volcano::web::HttpRequest Client::createSharedRequest(const std::string& target_path)
+    {
+        volcano::web::HttpRequest req{boost::beast::http::verb::get, target_path, 11};
+        req.set(boost::beast::http::field::host, target.host());
+        req.set(boost::beast::http::field::user_agent, "volcano-portal/1.0");
+        req.set(boost::beast::http::field::accept, volcano::web::accept_for(volcano::web::body_format_options.responses));
+        return req;
+    }
+
     volcano::web::HttpRequest Client::createAuthenticatedRequest(boost::beast::http::verb method, const std::string& target_path)
     {
         auto req = createBaseRequest(method, target_path);
@@ -153,8 +278,10 @@ namespace volcano::portal {
     volcano::web::HttpRequest Client::createJsonRequest(boost::beast::http::verb method, const std::string& target_path, const nlohmann::json& j)
     {
         auto req = createBaseRequest(method, target_path);
-        req.set(boost::beast::http::field::content_type, "application/json");
-        req.body() = j.dump();
+        // HttpClient re-sends this as JSON if the backend turns the binary form down.
+        const auto format = volcano::web::body_format_options.requests;
+        req.set(boost::beast::http::field::content_type, volcano::web::content_type_for(format));
+        req.body() = volcano::web::encode_body(j, format);
         req.prepare_payload();
         return req;
     }
@@ -201,6 +328,18 @@ namespace volcano::portal {
         co_return;
     }
 
+    void Client::setTokens(std::optional<JwtTokens> tokens)
+    {
+        tokens_ = std::move(tokens);
+        ++token_generation_;
+        if(tokens_) {
+            refresh_at_ = boost::asio::steady_timer::clock_type::now() + tokens_->expires_in;
+        }
+        // 0: tokens changed. A signal already pending covers this one too, since any
+        // due signal it holds is now for an old generation.
+        refresh_signal_->try_send(boost::system::error_code{}, std::uint64_t{0});
+    }
+
     boost::asio::awaitable<void> Client::runRefresher()
     {
         if (!handle_refresh_timer) {
@@ -208,47 +347,31 @@ namespace volcano::portal {
             co_return;
         }
 
+        // sleeps on refresh_signal_ between events, so a client without tokens costs no wakeups.
         for (;;) {
-            if (!tokens) {
-                refresh_timer_.expires_after(std::chrono::seconds(1));
-                boost::system::error_code ec;
-                co_await refresh_timer_.async_wait(boost::asio::bind_cancellation_slot(cancellation_state_.slot(), boost::asio::redirect_error(boost::asio::use_awaitable, ec)));
-                if (ec) {
-                    if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
-                        co_return;
-                    }
-                }
-                continue;
+            boost::system::error_code ec;
+            const auto generation = co_await refresh_signal_->async_receive(boost::asio::bind_cancellation_slot(cancellation_state_.slot(), boost::asio::redirect_error(boost::asio::use_awaitable, ec)));
+            if (ec) {
+                co_return;
             }
 
-            auto wait_for = tokens->expires_in;
-            if (wait_for <= boost::asio::steady_timer::duration::zero()) {
-                co_await handle_refresh_timer(*this);
+            if (!tokens_) {
+                refresh_scheduler().cancel(this);
                 continue;
             }
 
-            refresh_timer_.expires_after(wait_for);
-            boost::system::error_code ec;
-            co_await refresh_timer_.async_wait(boost::asio::bind_cancellation_slot(cancellation_state_.slot(), boost::asio::redirect_error(boost::asio::use_awaitable, ec)));
-            if (ec) {
-                if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
-                    co_return;
-                }
+            // a due signal for the current tokens is authoritative, even inside batch_window of
+            // refresh_at_; one for older tokens (folded by the 1-slot channel) only reschedules.
+            if (generation != token_generation_) {
+                refresh_scheduler().schedule(this, refresh_at_, token_generation_, refresh_signal_);
                 continue;
             }
 
-            if (!handle_refresh_timer) {
-                LERROR("No refresh handler configured for portal client refresher.");
-                co_return;
-            }
-
             auto res = co_await handle_refresh_timer(*this);
             if(res) {
-                tokens = std::move(*res);
+                setTokens(std::move(*res));
             } else {
-                tokens.reset();
-                // we should probably notify the mode handler here...
-                co_return;
+                tokens_.reset();
             }
         }
     }
@@ -259,31 +382,31 @@ namespace volcano::portal {
         co_return;
     }
 
-    boost::asio::awaitable<void> Client::sendText(const std::string& text)
+    boost::asio::awaitable<void> Client::sendText(std::string text)
     {
         if (!link_ || !link_->to_telnet) {
             co_return;
         }
-        boost::system::error_code ec;
-        co_await link_->to_telnet->async_send(
-            ec,
-            volcano::telnet::TelnetMessageData{text},
-            boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-        if(ec) {
-            LERROR("Failed to send text to telnet link {}: {}", *link_, ec.message());
+        report_send(*link_, co_await link_->async_send(volcano::telnet::TelnetMessageData{std::move(text)}), "text");
+    }
+
+    boost::asio::awaitable<void> Client::sendText(std::shared_ptr<const std::string> text)
+    {
+        if (!link_ || !link_->to_telnet || !text) {
+            co_return;
         }
+        report_send(*link_, co_await link_->async_send(volcano::telnet::TelnetMessageBuffer{std::move(text)}), "text");
     }
 
-    boost::asio::awaitable<void> Client::sendLine(const std::string& text)
+    boost::asio::awaitable<void> Client::sendLine(std::string text)
     {
         if (!link_ || !link_->to_telnet) {
             co_return;
         }
-        if(boost::algorithm::ends_with(text, "\r\n")) {
-            co_await sendText(text);
-        } else {
-            co_await sendText(text + "\r\n");
+        if(!boost::algorithm::ends_with(text, "\r\n")) {
+            text += "\r\n";
         }
+        co_await sendText(std::move(text));
         co_return;
     }
 
@@ -292,14 +415,15 @@ namespace volcano::portal {
         if (!link_ || !link_->to_telnet) {
             co_return;
         }
-        boost::system::error_code ec;
-        co_await link_->to_telnet->async_send(
-            ec,
-            volcano::telnet::TelnetMessageGMCP{package, data},
-            boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-        if(ec) {
-            LERROR("Failed to send GMCP to telnet link {}: {}", *link_, ec.message());
+        report_send(*link_, co_await link_->async_send(volcano::telnet::TelnetMessageGMCP{package, data}), "GMCP");
+    }
+
+    boost::asio::awaitable<void> Client::sendGMCP(std::shared_ptr<const volcano::telnet::PreparedGMCP> prepared)
+    {
+        if (!link_ || !link_->to_telnet || !prepared) {
+            co_return;
         }
+        report_send(*link_, co_await link_->async_send(volcano::telnet::TelnetMessagePreparedGMCP{std::move(prepared)}), "GMCP");
     }
 
     boost::asio::awaitable<void> Client::sendMSSP(const std::vector<std::pair<std::string, std::string>>& mssp_data)
@@ -307,14 +431,7 @@ namespace volcano::portal {
         if (!link_ || !link_->to_telnet) {
             co_return;
         }
-        boost::system::error_code ec;
-        co_await link_->to_telnet->async_send(
-            ec,
-            volcano::telnet::TelnetMessageMSSP{mssp_data},
-            boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-        if(ec) {
-            LERROR("Failed to send MSSP to telnet link {}: {}", *link_, ec.message());
-        }
+        report_send(*link_, co_await link_->async_send(volcano::telnet::TelnetMessageMSSP{mssp_data}), "MSSP");
     }
 
     boost::asio::awaitable<void> Client::sendDisconnect()
@@ -322,14 +439,7 @@ namespace volcano::portal {
         if (!link_ || !link_->to_telnet) {
             co_return;
         }
-        boost::system::error_code ec;
-        co_await link_->to_telnet->async_send(
-            ec,
-            volcano::telnet::TelnetDisconnect::server_disconnect,
-            boost::asio::redirect_error(boost::asio::use_awaitable, ec));
-        if(ec) {
-            LERROR("Failed to send Disconnect to telnet link {}: {}", *link_, ec.message());
-        }
+        report_send(*link_, co_await link_->async_send(volcano::telnet::TelnetDisconnect::server_disconnect), "Disconnect");
     }
 
     boost::asio::awaitable<void> Client::enqueueMode(std::shared_ptr<ModeHandler> next)
@@ -342,7 +452,7 @@ namespace volcano::portal {
         co_return;
     }
 
-    volcano::telnet::Channel<volcano::telnet::TelnetToGameMessage>& Client::telnetToGameChannel()
+    volcano::telnet::ToGameQueue& Client::telnetToGameQueue()
     {
         return *link_->to_game;
     }
@@ -350,6 +460,7 @@ namespace volcano::portal {
     boost::asio::awaitable<void> Client::changeCapabilities(const nlohmann::json& j)
     {
         j.get_to(link_->client_data);
+        update_broadcast_link(link_->connection_id, link_->client_data);
         co_return;
     }
 
@@ -0,0 +1,471 @@
+#include "volcano/portal/GameBus.hpp"
+#include "volcano/log/Log.hpp"
+#include "volcano/mud/ClientDataSave.hpp"
+#include "volcano/net/net.hpp"
+
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace volcano::portal {
+
+    GameBusOptions game_bus_options;
+
+    BusSession::BusSession(GameBus& bus, std::int64_t id, nlohmann::json info)
+        : bus_(bus),
+          id_(id),
+          info_(std::move(info)),
+          send_credits_(game_bus_options.credits),
+          credit_signal_(volcano::net::context(), 1),
+          // the game can't have more than a window outstanding, plus the final disconnect.
+          inbound_(volcano::net::context(), static_cast<std::size_t>(game_bus_options.credits) + 1)
+    {
+    }
+
+    nlohmann::json BusSession::openFrame()
+    {
+        const int room = std::max(0, game_bus_options.credits - queued_.load(std::memory_order_acquire));
+        return {{"t", "open"}, {"s", id_}, {"info", info_}, {"credits", room}};
+    }
+
+    boost::asio::awaitable<bool> BusSession::sendFrame(nlohmann::json frame, boost::asio::cancellation_slot slot)
+    {
+        while (send_credits_.load(std::memory_order_acquire) <= 0) {
+            if (closed_) {
+                co_return false;
+            }
+            boost::system::error_code ec;
+            co_await credit_signal_.async_receive(boost::asio::bind_cancellation_slot(slot, boost::asio::redirect_error(boost::asio::use_awaitable, ec)));
+            if (ec) {
+                co_return false;
+            }
+        }
+        if (closed_) {
+            co_return false;
+        }
+        send_credits_.fetch_sub(1, std::memory_order_acq_rel);
+        co_return co_await bus_.send(id_, frame, GameBus::OutboundFrame::Kind::command);
+    }
+
+    boost::asio::awaitable<bool> BusSession::sendCommand(std::string command, boost::asio::cancellation_slot slot)
+    {
+        co_return co_await sendFrame({{"t", "cmd"}, {"s", id_}, {"d", std::move(command)}}, slot);
+    }
+
+    boost::asio::awaitable<bool> BusSession::sendGMCP(std::string package, nlohmann::json data, boost::asio::cancellation_slot slot)
+    {
+        co_return co_await sendFrame({{"t", "gmcp"}, {"s", id_}, {"p", std::move(package)}, {"d", std::move(data)}}, slot);
+    }
+
+    boost::asio::awaitable<std::optional<BusEvent>> BusSession::receive(boost::asio::cancellation_slot slot)
+    {
+        boost::system::error_code ec;
+        auto event = co_await inbound_.async_receive(boost::asio::bind_cancellation_slot(slot, boost::asio::redirect_error(boost::asio::use_awaitable, ec)));
+        if (ec) {
+            co_return std::nullopt;
+        }
+        queued_.fetch_sub(1, std::memory_order_acq_rel);
+        co_return event;
+    }
+
+    boost::asio::awaitable<void> BusSession::consumed()
+    {
+        const int batch = std::max(1, game_bus_options.credits / 2);
+        if (unacknowledged_.fetch_add(1, std::memory_order_acq_rel) + 1 < batch) {
+            co_return;
+        }
+        const int granted = unacknowledged_.exchange(0, std::memory_order_acq_rel);
+        if (granted > 0 && !closed_) {
+            co_await bus_.send(id_, {{"t", "credit"}, {"s", id_}, {"n", granted}});
+        }
+    }
+
+    boost::asio::awaitable<void> BusSession::close()
+    {
+        if (closed_.exchange(true)) {
+            co_return;
+        }
+        bus_.forget(id_);
+        inbound_.close();
+        credit_signal_.close();
+        if (bus_.connected()) {
+            co_await bus_.send(id_, {{"t", "close"}, {"s", id_}}, GameBus::OutboundFrame::Kind::close);
+        }
+    }
+
+    void BusSession::deliver(BusEvent event)
+    {
+        queued_.fetch_add(1, std::memory_order_acq_rel);
+        if (!inbound_.try_send(boost::system::error_code{}, std::move(event))) {
+            queued_.fetch_sub(1, std::memory_order_acq_rel);
+            LERROR("Game bus session {} went past its credit; dropping a frame.", id_);
+        }
+    }
+
+    void BusSession::grant(int credits)
+    {
+        send_credits_.fetch_add(credits, std::memory_order_acq_rel);
+        credit_signal_.try_send(boost::system::error_code{}, true);
+    }
+
+    void BusSession::freeze()
+    {
+        send_credits_.store(0, std::memory_order_release);
+    }
+
+    void BusSession::reset(int replayed)
+    {
+        // added rather than stored: a command that got past the credit check just
+        // before freeze() has already taken its credit out of the new window.
+        send_credits_.fetch_add(game_bus_options.credits - replayed, std::memory_order_acq_rel);
+        // the re-open grants from free space, so nothing consumed earlier is owed.
+        unacknowledged_.store(0, std::memory_order_release);
+        credit_signal_.try_send(boost::system::error_code{}, true);
+    }
+
+    GameBus::GameBus()
+        : outbound_(volcano::net::context(), game_bus_options.outbound_queue)
+    {
+    }
+
+    boost::asio::awaitable<std::shared_ptr<BusSession>> GameBus::open(std::int64_t id, nlohmann::json info)
+    {
+        auto session = std::make_shared<BusSession>(*this, id, std::move(info));
+        bool announce;
+        {
+            std::lock_guard lock(mutex_);
+            sessions_[id] = session;
+            if (!running_) {
+                running_ = true;
+                boost::asio::co_spawn(boost::asio::make_strand(volcano::net::context()), run(), boost::asio::detached);
+            }
+            // otherwise the writer announces it when the bus (re)connects.
+            announce = connected_.load(std::memory_order_relaxed);
+        }
+        if (announce) {
+            co_await send(id, session->openFrame());
+        }
+        co_return session;
+    }
+
+    void GameBus::forget(std::int64_t id)
+    {
+        std::lock_guard lock(mutex_);
+        sessions_.erase(id);
+    }
+
+    boost::asio::awaitable<bool> GameBus::send(std::int64_t session, const nlohmann::json& frame, OutboundFrame::Kind kind)
+    {
+        boost::system::error_code ec;
+        co_await outbound_.async_send(boost::system::error_code{},
+                                      OutboundFrame{session, kind, volcano::web::encode_body(frame, game_bus_options.format)},
+                                      boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        co_return !ec;
+    }
+
+    boost::asio::awaitable<void> GameBus::run()
+    {
+        using namespace boost::asio::experimental::awaitable_operators;
+
+        boost::asio::steady_timer delay(co_await boost::asio::this_coro::executor);
+        for (;;) {
+            // anything thrown on one connection costs that connection, not the bus.
+            try {
+                if (auto ws = co_await connect()) {
+                    LINFO("Game bus connected to {}{}.", target.host(), game_bus_options.path);
+                    co_await (readLoop(*ws) || writeLoop(*ws));
+                    connected_ = false;
+                    LERROR("Game bus connection lost; reconnecting.");
+                }
+            } catch (const std::exception& e) {
+                connected_ = false;
+                LERROR("Game bus connection failed: {}; reconnecting.", e.what());
+            }
+
+            delay.expires_after(game_bus_options.reconnect_delay);
+            boost::system::error_code ec;
+            co_await delay.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        }
+    }
+
+    boost::asio::awaitable<std::optional<volcano::web::WebSocketStream>> GameBus::connect()
+    {
+        volcano::net::ConnectOptions options{};
+        options.tcp_no_delay = true;
+        options.keep_alive = true;
+        if (target.scheme == volcano::web::HttpScheme::https) {
+            auto tls = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tls_client);
+            tls->set_verify_mode(boost::asio::ssl::verify_none);
+            options.transport = volcano::net::TransportMode::tls;
+            options.tls_context = std::move(tls);
+        }
+
+        auto connected = co_await volcano::net::connect_any(target.address, target.port, options);
+        if (!connected) {
+            LERROR("Game bus could not connect to {}: {}", target.host(), connected.error().message());
+            co_return std::nullopt;
+        }
+
+        std::optional<volcano::web::WebSocketStream> ws;
+        ws.emplace(std::move(*connected));
+        ws->set_option(boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::client));
+        ws->set_option(boost::beast::websocket::stream_base::decorator([](boost::beast::websocket::request_type& req) {
+            req.set(boost::beast::http::field::user_agent, "volcano-portal/1.0");
+            if (!game_bus_options.token.empty()) {
+                req.set(boost::beast::http::field::authorization, "Bearer " + game_bus_options.token);
+            }
+        }));
+        ws->binary(game_bus_options.format != volcano::web::BodyFormat::json);
+
+        boost::system::error_code ec;
+        co_await ws->async_handshake(target.host(), game_bus_options.path, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (ec) {
+            LERROR("Game bus handshake with {} failed: {}", target.host(), ec.message());
+            co_return std::nullopt;
+        }
+        co_return ws;
+    }
+
+    boost::asio::awaitable<void> GameBus::writeLoop(volcano::web::WebSocketStream& ws)
+    {
+        std::vector<std::shared_ptr<BusSession>> live;
+        {
+            std::lock_guard lock(mutex_);
+            for (auto it = sessions_.begin(); it != sessions_.end();) {
+                if (auto session = it->second.lock()) {
+                    session->freeze();
+                    live.push_back(std::move(session));
+                    ++it;
+                } else {
+                    it = sessions_.erase(it);
+                }
+            }
+            connected_ = true;
+        }
+
+        // whatever was queued for the old connection: commands and closes are resent
+        // after the re-opens, opens and credits are replaced by them.
+        while (outbound_.try_receive([this](boost::system::error_code ec, OutboundFrame frame) {
+            if (!ec && frame.kind != OutboundFrame::Kind::control) {
+                unsent_.push_back(std::move(frame));
+            }
+        })) {
+        }
+
+        std::unordered_map<std::int64_t, int> replayed;
+        std::erase_if(unsent_, [&](const OutboundFrame& frame) {
+            if (frame.kind != OutboundFrame::Kind::command) {
+                return false;
+            }
+            const bool alive = std::ranges::any_of(live, [&frame](const auto& session) { return session->id() == frame.session; });
+            if (alive) {
+                ++replayed[frame.session];
+            }
+            return !alive;
+        });
+
+        boost::system::error_code ec;
+        for (auto& session : live) {
+            session->reset(replayed[session->id()]);
+            auto frame = volcano::web::encode_body(session->openFrame(), game_bus_options.format);
+            co_await ws.async_write(boost::asio::buffer(frame), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+        }
+        live.clear();
+
+        std::size_t sent = 0;
+        for (; sent < unsent_.size(); ++sent) {
+            co_await ws.async_write(boost::asio::buffer(unsent_[sent].bytes), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            if (ec) {
+                LERROR("Game bus write failed ({}); holding {} frames for the next connection.", ec.message(), unsent_.size() - sent);
+                unsent_.erase(unsent_.begin(), unsent_.begin() + static_cast<std::ptrdiff_t>(sent));
+                co_return;
+            }
+        }
+        unsent_.clear();
+
+        for (;;) {
+            auto frame = co_await outbound_.async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+            co_await ws.async_write(boost::asio::buffer(frame.bytes), boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            if (ec) {
+                LERROR("Game bus write for session {} failed ({}); holding it for the next connection.", frame.session, ec.message());
+                unsent_.push_back(std::move(frame));
+                co_return;
+            }
+        }
+    }
+
+    boost::asio::awaitable<void> GameBus::readLoop(volcano::web::WebSocketStream& ws)
+    {
+        boost::beast::flat_buffer buffer;
+        for (;;) {
+            boost::system::error_code ec;
+            co_await ws.async_read(buffer, boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+
+            auto data = buffer.cdata();
+            std::string_view body(static_cast<const char*>(data.data()), data.size());
+            auto frame = volcano::web::decode_body(body, ws.got_binary() ? game_bus_options.format : volcano::web::BodyFormat::json);
+            buffer.consume(buffer.size());
+
+            if (!frame || !frame->is_object()) {
+                LERROR("Game bus received a malformed frame: {}", frame ? "not a map" : frame.error());
+                continue;
+            }
+            dispatch(*frame);
+        }
+    }
+
+    void GameBus::dispatch(const nlohmann::json& frame)
+    {
+        // the game is trusted to be well-behaved, not well-formed: a mistyped field skips the frame.
+        const auto type_it = frame.find("t");
+        const auto id_it = frame.find("s");
+        if (type_it == frame.end() || !type_it->is_string() || id_it == frame.end() || !id_it->is_number_integer()) {
+            LERROR("Game bus received a frame without a string 't' and an integer 's'; skipping it.");
+            return;
+        }
+        const auto& type = type_it->get_ref<const std::string&>();
+        const auto id = id_it->get<std::int64_t>();
+
+        // absent is fine and reads as empty; present with another type is not.
+        auto string_field = [&frame](const char* key) -> std::optional<std::string> {
+            auto it = frame.find(key);
+            if (it == frame.end()) {
+                return std::string{};
+            }
+            if (!it->is_string()) {
+                return std::nullopt;
+            }
+            return it->get<std::string>();
+        };
+
+        std::shared_ptr<BusSession> session;
+        {
+            std::lock_guard lock(mutex_);
+            if (auto it = sessions_.find(id); it != sessions_.end()) {
+                session = it->second.lock();
+            }
+        }
+        if (!session) {
+            // frames racing a close are expected; anything else is worth a look.
+            LDEBUG("Game bus frame '{}' for unknown session {}.", type, id);
+            return;
+        }
+
+        if (type == "text") {
+            auto data = string_field("d");
+            if (!data) {
+                LERROR("Game bus text frame for session {} has a non-string 'd'; skipping it.", id);
+                return;
+            }
+            session->deliver(BusEvent{BusEvent::Kind::text, std::move(*data), {}});
+        } else if (type == "gmcp") {
+            auto package = string_field("p");
+            if (!package) {
+                LERROR("Game bus gmcp frame for session {} has a non-string 'p'; skipping it.", id);
+                return;
+            }
+            session->deliver(BusEvent{BusEvent::Kind::gmcp, std::move(*package), frame.value("d", nlohmann::json{})});
+        } else if (type == "disconnect") {
+            session->deliver(BusEvent{BusEvent::Kind::disconnect, {}, {}});
+        } else if (type == "credit") {
+            const auto n = frame.find("n");
+            if (n == frame.end() || !n->is_number_integer() || n->get<std::int64_t>() <= 0 ||
+                n->get<std::int64_t>() > std::numeric_limits<int>::max()) {
+                LERROR("Game bus credit frame for session {} has no positive integer 'n'; skipping it.", id);
+                return;
+            }
+            session->grant(n->get<int>());
+        } else {
+            LERROR("Game bus received unknown frame type '{}'.", type);
+        }
+    }
+
+    GameBus& game_bus()
+    {
+        static GameBus bus;
+        return bus;
+    }
+
+    nlohmann::json GameBusMode::sessionInfo()
+    {
+        auto& link = client_.link();
+        nlohmann::json info = {
+            {"connection_id", link.connection_id},
+            {"address", link.address.to_string()},
+            {"hostname", link.hostname},
+            {"client", link.client_data},
+        };
+        if (auto& tokens = client_.tokens()) {
+            info["jwt"] = tokens->jwt;
+        }
+        return info;
+    }
+
+    void GameBusMode::requestCancel()
+    {
+        ModeHandler::requestCancel();
+        events_cancel_.emit(boost::asio::cancellation_type::all);
+    }
+
+    boost::asio::awaitable<void> GameBusMode::enterMode()
+    {
+        session_ = co_await game_bus().open(client_.link().connection_id, sessionInfo());
+    }
+
+    boost::asio::awaitable<void> GameBusMode::exitMode()
+    {
+        if (session_) {
+            co_await session_->close();
+        }
+    }
+
+    boost::asio::awaitable<void> GameBusMode::runImpl()
+    {
+        for (;;) {
+            auto event = co_await session_->receive(events_cancel_.slot());
+            if (!event) {
+                co_return;
+            }
+
+            switch (event->kind) {
+                case BusEvent::Kind::text:
+                    co_await client_.sendText(std::move(event->text));
+                    break;
+                case BusEvent::Kind::gmcp:
+                    co_await client_.sendGMCP(event->text, event->data);
+                    break;
+                case BusEvent::Kind::disconnect:
+                    co_await client_.sendDisconnect();
+                    requestCancel();
+                    co_return;
+            }
+            // credit goes back only once the output is queued to the client.
+            co_await session_->consumed();
+        }
+    }
+
+    boost::asio::awaitable<void> GameBusMode::handleCommand(const std::string& data)
+    {
+        co_await session_->sendCommand(data, cancellationSlot());
+    }
+
+    boost::asio::awaitable<void> GameBusMode::handleGMCP(const volcano::telnet::TelnetReceivedGMCP& gmcp)
+    {
+        co_await session_->sendGMCP(gmcp.package, gmcp.data(), cancellationSlot());
+    }
+}
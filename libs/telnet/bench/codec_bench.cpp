@@ -0,0 +1,443 @@
+// Times the telnet codec on representative input: plain text, IAC-dense binary,
+// large GMCP JSON and pasted multi-line input. Each case reports ns per byte and
+// heap allocations per message, so codec changes can be judged with numbers.
+// Before timing anything it checks the outbound text path's wire bytes and exits
+// with 2 if they are wrong. Last, it counts what each connection's option state
+// costs against the per-connection option objects it replaced.
+//
+//   volcano_telnet_bench [rounds]
+
+#include "Codec.hpp"
+
+#include <volcano/telnet/Charset.hpp>
+#include <volcano/telnet/LineAssembler.hpp>
+#include <volcano/telnet/Option.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    std::atomic<std::size_t> allocations{0};
+    std::atomic<std::size_t> allocated_bytes{0};
+}
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    using namespace volcano::telnet;
+
+    // keeps results observable so the loops aren't optimised away.
+    std::size_t sink = 0;
+
+    struct Result {
+        std::size_t bytes{0};
+        std::size_t messages{0};
+    };
+
+    // runs body `rounds` times; body returns the bytes and messages it handled in one round.
+    template<typename F>
+    void measure(const char* name, std::size_t rounds, F&& body) {
+        Result total;
+        const std::size_t before = allocations.load(std::memory_order_relaxed);
+        const auto started = std::chrono::steady_clock::now();
+        for (std::size_t round = 0; round < rounds; ++round) {
+            const auto r = body();
+            total.bytes += r.bytes;
+            total.messages += r.messages;
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+        const auto allocs = allocations.load(std::memory_order_relaxed) - before;
+
+        std::printf("%-22s %12zu %10zu %10.3f %12.2f\n", name, total.bytes, total.messages,
+                    elapsed / static_cast<double>(total.bytes),
+                    static_cast<double>(allocs) / static_cast<double>(total.messages));
+    }
+
+    std::string make_plain(std::size_t bytes) {
+        static const char* words[] = {
+            "the", "a", "stone", "ancient", "light", "shadows", "north", "south", "guard",
+            "flickers", "across", "walls", "you", "see", "here", "dragon", "sword", "gold",
+        };
+        std::mt19937 rng(1280);
+        std::string out;
+        while (out.size() < bytes) {
+            out += "\x1b[1;32m";
+            for (int w = 0; w < 14; ++w) {
+                out += words[rng() % std::size(words)];
+                out += ' ';
+            }
+            out += "\x1b[0m\r\n";
+        }
+        return out;
+    }
+
+    // random bytes, so roughly one in 256 is IAC, with a negotiation or command mixed in regularly.
+    std::string make_iac_dense(std::size_t bytes) {
+        std::mt19937 rng(255);
+        std::string out;
+        while (out.size() < bytes) {
+            for (int i = 0; i < 32; ++i) {
+                const auto ch = static_cast<char>(rng() & 0xff);
+                out.push_back(ch);
+                if (ch == codes::IAC) {
+                    out.push_back(codes::IAC);
+                }
+            }
+            switch (rng() % 3) {
+                case 0:
+                    out += {codes::IAC, codes::WILL, codes::NAWS};
+                    break;
+                case 1:
+                    out += {codes::IAC, codes::NOP};
+                    break;
+                default:
+                    append_subnegotiation(out, codes::NAWS, std::string_view("\x00\x50\x00\x18", 4));
+                    break;
+            }
+        }
+        return out;
+    }
+
+    std::string make_gmcp_json(std::size_t entries) {
+        std::string json = "{\"room\":{\"num\":3001,\"name\":\"The Temple Square\",\"exits\":{\"n\":3002,\"s\":3003}},\"items\":[";
+        for (std::size_t i = 0; i < entries; ++i) {
+            if (i) {
+                json += ',';
+            }
+            json += "{\"id\":" + std::to_string(1000 + i) +
+                ",\"name\":\"a gleaming longsword of the ancients\",\"flags\":[\"glow\",\"hum\",\"magic\"],\"weight\":" +
+                std::to_string(i % 40) + "}";
+        }
+        json += "]}";
+        return json;
+    }
+
+    std::string make_paste(std::size_t lines) {
+        std::mt19937 rng(77);
+        std::string out;
+        for (std::size_t i = 0; i < lines; ++i) {
+            out += "say line ";
+            out += std::to_string(i);
+            out += " of a pasted block of text, more or less the length of a typed command";
+            if (rng() % 16 == 0) {
+                out += "x\x7f";
+            }
+            out += "\r\n";
+        }
+        return out;
+    }
+
+    Result parse_all(std::string_view data) {
+        Result r{data.size(), 0};
+        while (!data.empty()) {
+            auto parsed = parseTelnetMessage(data);
+            if (!parsed) {
+                break;
+            }
+            sink += parsed->first.index();
+            data.remove_prefix(parsed->second);
+            ++r.messages;
+        }
+        return r;
+    }
+
+    // mirrors TelnetConnection::runWriter up to MCCP: protocol messages are encoded into
+    // scratch, app text is transcoded for the client's charset and IAC-escaped.
+    Result encode_all(const std::vector<TelnetMessage>& messages, Charset charset = Charset::utf8) {
+        Result r;
+        std::string scratch;
+        std::string escaped;
+        for (const auto& msg : messages) {
+            auto payload = messagePayload(msg, scratch);
+            if (std::holds_alternative<TelnetMessageData>(msg) || std::holds_alternative<TelnetMessageBuffer>(msg)) {
+                payload = encode_app_data(charset, payload, escaped);
+            }
+            sink += payload.size();
+            r.bytes += payload.size();
+            ++r.messages;
+        }
+        return r;
+    }
+
+    // characters that land on 0xFF in a client charset must reach the wire as exactly one IAC IAC.
+    bool check_wire() {
+        struct Case {
+            const char* name;
+            Charset charset;
+            std::string_view utf8;
+        };
+        const Case cases[] = {
+            {"latin1 U+00FF", Charset::latin1, "\xc3\xbf"},
+            {"cp437 U+00A0", Charset::cp437, "\xc2\xa0"},
+        };
+        bool ok = true;
+        for (const auto& c : cases) {
+            std::string scratch;
+            if (encode_app_data(c.charset, c.utf8, scratch) != std::string_view("\xff\xff", 2)) {
+                std::fprintf(stderr, "wire check failed: %s is not sent as IAC IAC\n", c.name);
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    // the per-connection option objects TelnetOptionStates replaced: one heap object per
+    // option with a vtable, a connection reference, both states and a name-keyed map of
+    // pending channels, plus one channel per option that the connection also kept.
+    namespace legacy {
+        struct OptionState {
+            bool enabled{false};
+            bool negotiating{false};
+        };
+
+        struct Option {
+            explicit Option(void* connection) : tc(connection) {}
+            virtual ~Option() = default;
+
+            void* tc;
+            OptionState local;
+            OptionState remote;
+            std::unordered_map<std::string, std::shared_ptr<Channel<bool>>> pending_channels_;
+        };
+
+        struct CharsetOption : Option {
+            using Option::Option;
+            std::optional<std::string> enabled_;
+        };
+
+        struct MttsOption : Option {
+            using Option::Option;
+            int number_requests_ = 0;
+            std::string last_received_;
+        };
+
+        struct Connection {
+            std::unordered_map<char, std::shared_ptr<Option>> options_;
+            std::vector<std::shared_ptr<Channel<bool>>> pending_channels_;
+        };
+
+        template<typename T>
+        void add(Connection& c, boost::asio::io_context& ctx, char code, const char* name) {
+            auto option = std::make_shared<T>(&c);
+            auto channel = std::make_shared<Channel<bool>>(ctx.get_executor(), 1);
+            option->pending_channels_[name] = channel;
+            c.pending_channels_.push_back(channel);
+            c.options_.emplace(code, std::move(option));
+        }
+
+        // as the old TelnetConnection constructor and TelnetOption::start built them.
+        void build(Connection& c, boost::asio::io_context& ctx) {
+            add<Option>(c, ctx, codes::SGA, "SGA");
+            add<Option>(c, ctx, codes::NAWS, "NAWS");
+            add<CharsetOption>(c, ctx, codes::CHARSET, "CHARSET");
+            add<MttsOption>(c, ctx, codes::MTTS, "MTTS");
+            add<Option>(c, ctx, codes::MSSP, "MSSP");
+            add<Option>(c, ctx, codes::MCCP2, "MCCP2");
+            add<Option>(c, ctx, codes::MCCP3, "MCCP3");
+            add<Option>(c, ctx, codes::GMCP, "GMCP");
+            add<Option>(c, ctx, codes::LINEMODE, "LINEMODE");
+            add<Option>(c, ctx, codes::TELOPT_EOR, "EOR");
+        }
+    }
+
+    // builds `connections` connections' option state and reports heap allocations and
+    // bytes per connection, plus the bytes it takes inside the connection object itself.
+    template<typename T, typename F>
+    void measure_state(const char* name, std::size_t connections, F&& build) {
+        std::vector<T> built(connections);
+        const std::size_t allocs_before = allocations.load(std::memory_order_relaxed);
+        const std::size_t bytes_before = allocated_bytes.load(std::memory_order_relaxed);
+        for (auto& state : built) {
+            build(state);
+        }
+        const auto per = static_cast<double>(connections);
+        const auto allocs = static_cast<double>(allocations.load(std::memory_order_relaxed) - allocs_before) / per;
+        const auto heap = static_cast<double>(allocated_bytes.load(std::memory_order_relaxed) - bytes_before) / per;
+        std::printf("%-22s %12.1f %10.1f %10zu %12.1f\n", name, allocs, heap, sizeof(T), heap + static_cast<double>(sizeof(T)));
+        sink += built.size();
+    }
+
+    // mirrors TelnetConnection::handleAppData: 4 KB reads, one string per delivered line.
+    Result assemble_lines(std::string_view paste) {
+        Result r{paste.size(), 0};
+        LineAssembler assembler(telnet_limits.max_appdata_buffer);
+        for (std::size_t pos = 0; pos < paste.size(); pos += 4096) {
+            if (!assembler.feed(paste.substr(pos, 4096))) {
+                break;
+            }
+            std::vector<std::string> lines;
+            while (auto line = assembler.next_line()) {
+                lines.emplace_back(*line);
+            }
+            r.messages += lines.size();
+        }
+        return r;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t rounds = 50;
+    if (argc > 1) {
+        rounds = std::stoul(argv[1]);
+    }
+    if (!check_wire()) {
+        return 2;
+    }
+
+    const auto plain = make_plain(256 * 1024);
+    const auto iac_dense = make_iac_dense(256 * 1024);
+    const auto gmcp_json = make_gmcp_json(400);
+    const auto paste = make_paste(2000);
+
+    std::string gmcp_wire;
+    append_subnegotiation(gmcp_wire, codes::GMCP, "Char.Items.List " + gmcp_json);
+
+    std::vector<TelnetMessage> protocol_messages;
+    for (int i = 0; i < 1000; ++i) {
+        protocol_messages.emplace_back(TelnetMessageNegotiation{codes::WILL, codes::GMCP});
+        protocol_messages.emplace_back(TelnetMessageCommand{codes::NOP});
+        protocol_messages.emplace_back(TelnetMessageSubnegotiation{codes::NAWS, std::string("\x00\x50\x00\xff", 4)});
+    }
+
+    std::vector<TelnetMessage> text_messages;
+    for (std::size_t pos = 0; pos < plain.size(); pos += 512) {
+        text_messages.emplace_back(TelnetMessageData{plain.substr(pos, 512)});
+    }
+
+    // game text that is full of bytes needing IAC escapes: raw 0xFF for a UTF-8 client,
+    // and U+00FF, which becomes 0xFF once transcoded for a Latin-1 one.
+    std::vector<TelnetMessage> iac_text_messages;
+    std::vector<TelnetMessage> latin1_text_messages;
+    {
+        std::mt19937 rng(0xff);
+        for (std::size_t pos = 0; pos < plain.size(); pos += 512) {
+            std::string raw;
+            std::string accented;
+            for (char ch : std::string_view(plain).substr(pos, 512)) {
+                if (rng() % 8 == 0) {
+                    raw.push_back(codes::IAC);
+                    accented += "\xc3\xbf";
+                }
+                raw.push_back(ch);
+                accented.push_back(ch);
+            }
+            iac_text_messages.emplace_back(TelnetMessageData{std::move(raw)});
+            latin1_text_messages.emplace_back(TelnetMessageData{std::move(accented)});
+        }
+    }
+
+    TelnetMessageMSSP mssp;
+    for (const char* key : {"NAME", "PLAYERS", "UPTIME", "CODEBASE", "CONTACT", "CRAWL DELAY", "HOSTNAME", "PORT"}) {
+        mssp.variables.emplace_back(key, "some representative value");
+    }
+
+    std::printf("%-22s %12s %10s %10s %12s\n", "case", "bytes", "messages", "ns/byte", "allocs/msg");
+
+    measure("parse plain", rounds, [&] { return parse_all(plain); });
+    measure("parse iac-dense", rounds, [&] { return parse_all(iac_dense); });
+    measure("parse gmcp", rounds * 10, [&] { return parse_all(gmcp_wire); });
+
+    measure("encode text", rounds, [&] { return encode_all(text_messages); });
+    measure("encode text iac-dense", rounds, [&] { return encode_all(iac_text_messages); });
+    measure("encode text latin1", rounds, [&] { return encode_all(latin1_text_messages, Charset::latin1); });
+    measure("encode protocol", rounds, [&] { return encode_all(protocol_messages); });
+
+    measure("escape plain", rounds, [&] {
+        std::string out;
+        append_iac_escaped(out, plain);
+        sink += out.size();
+        return Result{plain.size(), 1};
+    });
+    measure("escape iac-dense", rounds, [&] {
+        std::string out;
+        append_iac_escaped(out, iac_dense);
+        sink += out.size();
+        return Result{iac_dense.size(), 1};
+    });
+
+    measure("line assembly paste", rounds, [&] { return assemble_lines(paste); });
+
+    measure("gmcp encode json", rounds * 10, [&] {
+        auto prepared = prepareGMCP("Char.Items.List", std::string_view(gmcp_json));
+        sink += prepared->frame.size();
+        return Result{gmcp_json.size(), 1};
+    });
+    measure("gmcp decode", rounds * 10, [&] {
+        auto parsed = parseTelnetMessage(gmcp_wire);
+        const auto& sub = std::get<TelnetMessageSubnegotiation>(parsed->first);
+        auto [package, json_text] = splitGMCP(sub.data);
+        TelnetReceivedGMCP received{std::string(package), std::string(json_text)};
+        sink += received.data().size();
+        return Result{gmcp_wire.size(), 1};
+    });
+
+    // mostly-ASCII room text with the odd accented name and box-drawing border.
+    std::string accented;
+    for (std::size_t pos = 0; pos < plain.size(); pos += 256) {
+        accented += plain.substr(pos, 256);
+        accented += "Ren\xc3\xa9e \xe2\x95\x94\xe2\x95\x90\xe2\x95\x97\r\n";
+    }
+    std::string cp437_input;
+    encode_from_utf8(Charset::cp437, accented, cp437_input);
+
+    measure("transcode out ascii", rounds, [&] {
+        std::string out;
+        encode_from_utf8(Charset::latin1, plain, out);
+        sink += out.size();
+        return Result{plain.size(), 1};
+    });
+    measure("transcode out cp437", rounds, [&] {
+        std::string out;
+        encode_from_utf8(Charset::cp437, accented, out);
+        sink += out.size();
+        return Result{accented.size(), 1};
+    });
+    measure("transcode in cp437", rounds, [&] {
+        std::string out;
+        decode_to_utf8(Charset::cp437, cp437_input, out);
+        sink += out.size();
+        return Result{cp437_input.size(), 1};
+    });
+
+    measure("mssp encode", rounds * 100, [&] {
+        auto encoded = encodeTelnetMessage(mssp.toSubnegotiation());
+        sink += encoded.size();
+        return Result{encoded.size(), 1};
+    });
+
+    std::printf("\n%-22s %12s %10s %10s %12s\n", "option state", "allocs/conn", "heap B", "inline B", "total B");
+    boost::asio::io_context ctx;
+    measure_state<legacy::Connection>("option objects", 1000, [&](legacy::Connection& c) { legacy::build(c, ctx); });
+    measure_state<TelnetOptionStates>("TelnetOptionStates", 1000, [](TelnetOptionStates& s) { s.pending = 0x3ff; });
+    std::printf("(each option object's Channel<bool> counted at %zu bytes)\n", sizeof(Channel<bool>));
+
+    return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+// Replays session recordings (telnet_limits.record_directory) through real
+// TelnetConnections over loopback sockets: the parser, option negotiation,
+// line assembly and the link handoff to the game all run as they do in
+// production. A stand-in game drains every link and checks that the lines it
+// receives match the game_input records of the original session.
+//
+//   volcano_telnet_replay [--speed X | --max] [--copies N] recording.vrec...
+//
+// --speed scales the recorded inbound timing (1 = wall clock), --max sends
+// everything as fast as the connection accepts it, --copies runs each
+// recording N times concurrently.
+
+#include <volcano/net/Base.hpp>
+#include <volcano/net/Connection.hpp>
+#include <volcano/telnet/Connection.hpp>
+#include <volcano/telnet/SessionRecording.hpp>
+
+#include <boost/asio/experimental/awaitable_operators.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    using namespace volcano::telnet;
+    using boost::asio::awaitable;
+    using boost::asio::use_awaitable;
+
+    struct Session {
+        const SessionRecording* recording;
+        std::vector<RecordView> inbound;
+        std::vector<std::string_view> expected_lines;
+        std::vector<std::string> observed_lines;
+        bool linked{false};
+        bool game_finished{false};
+    };
+
+    struct Totals {
+        std::size_t sessions{0};
+        std::size_t finished_connections{0};
+        std::size_t finished_games{0};
+        std::size_t inbound_bytes{0};
+        std::size_t outbound_bytes{0};
+        std::size_t mismatched_sessions{0};
+    };
+
+    double speed = 1.0;
+    Totals totals;
+    std::unordered_map<std::int64_t, Session> sessions;
+
+    void maybe_finish() {
+        if (totals.finished_connections == totals.sessions && totals.finished_games == totals.sessions) {
+            volcano::net::context().stop();
+        }
+    }
+
+    void check(std::int64_t id, Session& session) {
+        if (session.observed_lines.size() != session.expected_lines.size()) {
+            std::fprintf(stderr, "session %lld: expected %zu lines, game received %zu\n",
+                static_cast<long long>(id), session.expected_lines.size(), session.observed_lines.size());
+            ++totals.mismatched_sessions;
+            return;
+        }
+        for (std::size_t i = 0; i < session.expected_lines.size(); ++i) {
+            if (session.observed_lines[i] != session.expected_lines[i]) {
+                std::fprintf(stderr, "session %lld: line %zu differs\n", static_cast<long long>(id), i);
+                ++totals.mismatched_sessions;
+                return;
+            }
+        }
+    }
+
+    // a session's game side is done either when its link drains or, if the connection closed
+    // before a link was ever published, when the connection finishes.
+    void finish_game(std::int64_t id, Session& session) {
+        if (session.game_finished) {
+            return;
+        }
+        session.game_finished = true;
+        check(id, session);
+        ++totals.finished_games;
+        maybe_finish();
+    }
+
+    // stands in for the portal: collects what each connection delivers to the game.
+    awaitable<void> run_game() {
+        for (;;) {
+            boost::system::error_code ec;
+            auto link = co_await link_channel().async_receive(boost::asio::redirect_error(use_awaitable, ec));
+            if (ec) {
+                co_return;
+            }
+            boost::asio::co_spawn(volcano::net::context(), [link]() -> awaitable<void> {
+                auto& session = sessions.at(link->connection_id);
+                session.linked = true;
+                for (;;) {
+                    auto received = co_await link->to_game->receive();
+                    if (!received || std::holds_alternative<TelnetDisconnect>(*received)) {
+                        break;
+                    }
+                    auto& msg = std::get<TelnetGameMessage>(*received);
+                    if (auto* data = std::get_if<TelnetMessageData>(&msg)) {
+                        session.observed_lines.push_back(std::move(data->data));
+                    } else if (auto* lines = std::get_if<TelnetMessageLines>(&msg)) {
+                        for (auto& line : lines->lines) {
+                            session.observed_lines.push_back(std::move(line));
+                        }
+                    }
+                }
+                finish_game(link->connection_id, session);
+            }, boost::asio::detached);
+        }
+    }
+
+    // the client side: sends the recorded inbound bytes on schedule and drains whatever comes back.
+    awaitable<void> run_client(boost::asio::ip::tcp::socket client, const Session& session) {
+        using namespace boost::asio::experimental::awaitable_operators;
+
+        auto drain = [&]() -> awaitable<void> {
+            std::vector<char> buffer(16 * 1024);
+            for (;;) {
+                boost::system::error_code ec;
+                auto n = co_await client.async_read_some(boost::asio::buffer(buffer), boost::asio::redirect_error(use_awaitable, ec));
+                if (ec) {
+                    co_return;
+                }
+                totals.outbound_bytes += n;
+            }
+        };
+
+        auto feed = [&]() -> awaitable<void> {
+            boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor);
+            const auto started = std::chrono::steady_clock::now();
+            for (const auto& record : session.inbound) {
+                if (speed > 0) {
+                    timer.expires_at(started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(record.offset / speed));
+                    co_await timer.async_wait(use_awaitable);
+                }
+                boost::system::error_code ec;
+                co_await boost::asio::async_write(client, boost::asio::buffer(record.payload.data(), record.payload.size()),
+                    boost::asio::redirect_error(use_awaitable, ec));
+                if (ec) {
+                    co_return;
+                }
+                totals.inbound_bytes += record.payload.size();
+            }
+            boost::system::error_code ec;
+            client.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        };
+
+        co_await (drain() && feed());
+    }
+
+    // pairs are set up one at a time so each accepted socket belongs to the client just connected.
+    awaitable<void> replay_all(boost::asio::ip::tcp::acceptor& acceptor) {
+        for (auto& [id, session] : sessions) {
+            auto executor = boost::asio::make_strand(volcano::net::context());
+            boost::asio::ip::tcp::socket client(executor);
+            co_await client.async_connect(acceptor.local_endpoint(), use_awaitable);
+            auto server = co_await acceptor.async_accept(executor, use_awaitable);
+
+            const auto endpoint = server.remote_endpoint();
+            volcano::net::AnyStream stream(id, std::move(server), endpoint, "replay");
+            boost::asio::co_spawn(executor, [id, &session, stream = std::move(stream)]() mutable -> awaitable<void> {
+                {
+                    TelnetConnection telnet(std::move(stream));
+                    co_await telnet.run();
+                }
+                ++totals.finished_connections;
+                // a link published just before the close is still queued for run_game; let it land first.
+                co_await boost::asio::post(co_await boost::asio::this_coro::executor, use_awaitable);
+                if (!session.linked) {
+                    finish_game(id, session);
+                }
+                maybe_finish();
+            }, boost::asio::detached);
+            boost::asio::co_spawn(executor, run_client(std::move(client), session), boost::asio::detached);
+        }
+    }
+
+    Session load_session(const SessionRecording& recording) {
+        Session session{&recording, {}, {}, {}};
+        for (const auto& record : recording.records()) {
+            if (record.kind == RecordKind::inbound) {
+                session.inbound.push_back(record);
+            } else if (record.kind == RecordKind::game_input) {
+                session.expected_lines.push_back(record.payload);
+            }
+        }
+        return session;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t copies = 1;
+    std::vector<SessionRecording> recordings;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--max") {
+            speed = 0;
+        } else if (arg == "--speed" && i + 1 < argc) {
+            speed = std::stod(argv[++i]);
+        } else if (arg == "--copies" && i + 1 < argc) {
+            copies = std::stoul(argv[++i]);
+        } else {
+            auto recording = SessionRecording::open(argv[i]);
+            if (!recording) {
+                std::fprintf(stderr, "%s: %s\n", argv[i], recording.error().c_str());
+                return 1;
+            }
+            recordings.push_back(std::move(*recording));
+        }
+    }
+    if (recordings.empty()) {
+        std::fprintf(stderr, "usage: %s [--speed X | --max] [--copies N] recording.vrec...\n", argv[0]);
+        return 1;
+    }
+
+    // recordings live for the whole run; sessions keep views into their mappings.
+    auto& ctx = volcano::net::context();
+    boost::asio::ip::tcp::acceptor acceptor(ctx, {boost::asio::ip::address_v4::loopback(), 0});
+
+    std::int64_t next_id = 1;
+    for (std::size_t copy = 0; copy < copies; ++copy) {
+        for (const auto& recording : recordings) {
+            const auto id = next_id++;
+            sessions.emplace(id, load_session(recording));
+            ++totals.sessions;
+        }
+    }
+    boost::asio::co_spawn(ctx, run_game(), boost::asio::detached);
+    boost::asio::co_spawn(ctx, replay_all(acceptor), boost::asio::detached);
+
+    const auto started = std::chrono::steady_clock::now();
+    ctx.run();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::printf("sessions      %zu\n", totals.sessions);
+    std::printf("inbound       %zu bytes (%.2f MB/s)\n", totals.inbound_bytes,
+        static_cast<double>(totals.inbound_bytes) / seconds / (1024.0 * 1024.0));
+    std::printf("outbound      %zu bytes\n", totals.outbound_bytes);
+    std::printf("elapsed       %.3f s\n", seconds);
+    std::printf("mismatched    %zu\n", totals.mismatched_sessions);
+    return totals.mismatched_sessions == 0 ? 0 : 2;
+}
@@ -9,6 +9,8 @@
 #include <functional>
 #include <memory>
 #include <chrono>
+#include <filesystem>
+#include <optional>
 #include <atomic>
 #include <unordered_set>
 
@@ -20,6 +22,9 @@
 #include <boost/asio/experimental/concurrent_channel.hpp>
 
 #include "volcano/mud/ClientData.hpp"
+#include "volcano/telnet/Charset.hpp"
+#include "volcano/net/MessageQueue.hpp"
+#include "volcano/zlib/Zlib.hpp"
 
 namespace volcano::telnet {
     template<typename T>
@@ -54,10 +59,34 @@ namespace volcano::telnet {
         constexpr char GMCP          = static_cast<char>(201);
     }
 
+    // App data is plain UTF-8 text in both forms below; the connection's writer
+    // transcodes it and doubles any IAC bytes, so senders never escape it themselves.
     struct TelnetMessageData {
         std::string data;
     };
 
+    // Immutable app data that can be shared between connections without copying.
+    struct TelnetMessageBuffer {
+        std::shared_ptr<const std::string> data;
+    };
+
+    // Shared app text that was already encoded once for a charset (transcoded and
+    // IAC-escaped, see encode_app_data). A writer whose connection uses that charset
+    // sends `wire` as it is; any other writer encodes `text` as for TelnetMessageBuffer.
+    struct TelnetMessageWire {
+        std::shared_ptr<const std::string> text;
+        std::shared_ptr<const std::string> wire;
+        Charset charset{Charset::utf8};
+    };
+
+    // Consecutive input lines from one read, delivered to the game together.
+    struct TelnetMessageLines {
+        std::vector<std::string> lines;
+    };
+
+    // Appends data with every IAC byte doubled, as the wire format requires.
+    void append_iac_escaped(std::string& out, std::string_view data);
+
     struct TelnetMessageSubnegotiation {
         char option; // e.g., TERMINAL TYPE, MCCP, etc.
         std::string data;
@@ -78,6 +107,38 @@ namespace volcano::telnet {
         TelnetMessageSubnegotiation toSubnegotiation() const;
     };
 
+    // Inbound GMCP. The body is kept as the client sent it and only parsed when asked for.
+    struct TelnetReceivedGMCP {
+        std::string package;
+        std::string payload;
+
+        // Parses payload on every call; null if it is empty or not valid JSON.
+        nlohmann::json data() const;
+
+        template<typename T>
+        std::optional<T> data_as() const {
+            try {
+                return data().template get<T>();
+            } catch (const nlohmann::json::exception&) {
+                return std::nullopt;
+            }
+        }
+    };
+
+    // A GMCP message already encoded as IAC SB GMCP ... IAC SE, ready to be
+    // written to any number of connections as-is.
+    struct PreparedGMCP {
+        std::string package;
+        std::string frame;
+    };
+
+    std::shared_ptr<const PreparedGMCP> prepareGMCP(std::string package, const nlohmann::json& data);
+    std::shared_ptr<const PreparedGMCP> prepareGMCP(std::string package, std::string_view json_text);
+
+    struct TelnetMessagePreparedGMCP {
+        std::shared_ptr<const PreparedGMCP> gmcp;
+    };
+
     struct TelnetMessageMSSP {
         std::vector<std::pair<std::string, std::string>> variables;
         TelnetMessageSubnegotiation toSubnegotiation() const;
@@ -88,10 +149,10 @@ namespace volcano::telnet {
     };
     
     using TelnetMessage = std::variant<TelnetMessageData, TelnetMessageSubnegotiation, 
-        TelnetMessageNegotiation, TelnetMessageCommand, TelnetMessageGMCP>;
+        TelnetMessageNegotiation, TelnetMessageCommand, TelnetMessageGMCP, TelnetMessageBuffer, TelnetMessagePreparedGMCP, TelnetMessageWire>;
     
-    using TelnetGameMessage = std::variant<TelnetMessageData, TelnetMessageGMCP, TelnetChangeCapabilities>;
-    using TelnetClientMessage = std::variant<TelnetMessageData, TelnetMessageGMCP, TelnetMessageMSSP>;
+    using TelnetGameMessage = std::variant<TelnetMessageData, TelnetMessageLines, TelnetReceivedGMCP, TelnetChangeCapabilities>;
+    using TelnetClientMessage = std::variant<TelnetMessageData, TelnetMessageBuffer, TelnetMessageGMCP, TelnetMessagePreparedGMCP, TelnetMessageMSSP, TelnetMessageWire>;
 
     enum class TelnetDisconnect {
         socket_close,
@@ -103,11 +164,78 @@ namespace volcano::telnet {
     using TelnetToGameMessage = std::variant<TelnetGameMessage, TelnetDisconnect>;
     using TelnetToTelnetMessage = std::variant<TelnetClientMessage, TelnetDisconnect>;
 
+    // the connection's writer queue (OutgoingQueue.hpp); game-side producers push into it directly.
+    class OutgoingQueue;
+    using ToGameQueue = volcano::net::MessageQueue<TelnetToGameMessage>;
+
+    TelnetOutgoingMessage toOutgoingMessage(TelnetToTelnetMessage msg);
+
+    // MCCP2 deflate settings. The defaults use an 8 KB window and memLevel 6,
+    // roughly 70 KB of zlib state per compressing client instead of ~256 KB.
+    struct CompressionProfile {
+        volcano::zlib::DeflateOptions deflate{.level = 6, .window_bits = 13, .mem_level = 6};
+
+        // adaptive mode steps the level down (never below min_level) when a sample
+        // window compresses poorly or costs more CPU than the budget, and back up
+        // towards deflate.level once things are cheap again.
+        bool adaptive{true};
+        int min_level{1};
+        std::size_t sample_bytes{64 * 1024};
+        double poor_ratio{0.85};
+        std::chrono::nanoseconds cost_per_kib_budget{std::chrono::microseconds(25)};
+    };
+
+    // What a connection's writer queue does once a client stops keeping up with its output.
+    enum class SlowClientPolicy : std::uint8_t {
+        block,          // awaiting senders (TelnetLink::async_send) wait until the queue drains
+        drop_oldest,    // text and GMCP are discarded oldest-first until the queue drains
+        collapse_gmcp,  // queued GMCP is discarded when a newer message for the same package follows it
+        disconnect,     // the connection is closed once it has stayed over high_water for disconnect_after
+    };
+
+    // What became of a message handed to a connection's writer queue.
+    enum class PushResult : std::uint8_t {
+        queued,
+        dropped,    // refused at OutputLimits::hard_limit under a shedding policy
+        closed,     // the connection has shut down
+    };
+
+    struct OutputLimits {
+        // queued bytes past which the policy applies; shedding stops again at half of it.
+        std::size_t high_water{1024 * 1024};
+        // except under block, text and GMCP pushed past this are discarded on arrival.
+        std::size_t hard_limit{4 * 1024 * 1024};
+        // lossless by default; operators opt in to shedding output.
+        SlowClientPolicy policy{SlowClientPolicy::block};
+        boost::asio::steady_timer::duration disconnect_after{std::chrono::seconds(30)};
+    };
+
+    struct KeepAliveOptions {
+        // dead peers are found by kernel TCP keepalive: probes start after tcp_idle
+        // without traffic and the connection drops after tcp_count unanswered probes.
+        bool tcp_keepalive{true};
+        std::chrono::seconds tcp_idle{60};
+        std::chrono::seconds tcp_interval{10};
+        int tcp_count{6};
+        // telnet clients that were sent nothing for this long get an IAC NOP; zero disables it.
+        boost::asio::steady_timer::duration nop_interval{std::chrono::seconds(30)};
+    };
+
     struct TelnetLimits {
         std::size_t max_message_buffer{2 * 1024 * 1024};
         std::size_t max_appdata_buffer{64 * 1024};
+        // connection buffers left empty with more capacity than this are released back to the pool.
+        std::size_t idle_buffer_capacity{16 * 1024};
         boost::asio::steady_timer::duration negotiation_timeout{std::chrono::milliseconds(700)};
+        // clients that haven't sent a single telnet command by now are linked without waiting further.
+        boost::asio::steady_timer::duration negotiation_probe_timeout{std::chrono::milliseconds(250)};
+        std::size_t client_profile_cache_size{4096};
         std::unordered_set<std::string> idle_commands{"IDLE"};
+        CompressionProfile mccp2;
+        OutputLimits output;
+        KeepAliveOptions keepalive;
+        // when set, every connection's traffic is recorded to <dir>/<connection id>-<unix ms>.vrec.
+        std::filesystem::path record_directory;
     };
 
     extern TelnetLimits telnet_limits;
@@ -117,8 +245,16 @@ namespace volcano::telnet {
         boost::asio::ip::address address;
         std::string hostname;
         volcano::mud::ClientData client_data;
-        std::shared_ptr<Channel<TelnetToGameMessage>> to_game;
-        std::shared_ptr<Channel<TelnetToTelnetMessage>> to_telnet;
+        std::shared_ptr<ToGameQueue> to_game;
+        std::shared_ptr<OutgoingQueue> to_telnet;
+
+        // Queues a message for the client without waiting, whatever the policy.
+        PushResult send(TelnetToTelnetMessage msg) const;
+        // As send(), but text and GMCP past OutputLimits::hard_limit are dropped even
+        // under block, for senders that must not grow a stalled client's queue forever.
+        PushResult try_send(TelnetToTelnetMessage msg) const;
+        // As send(), but under SlowClientPolicy::block waits for the queue to drain first.
+        boost::asio::awaitable<PushResult> async_send(TelnetToTelnetMessage msg) const;
     };
 
     inline auto format_as(const TelnetLink& telnet_link) {
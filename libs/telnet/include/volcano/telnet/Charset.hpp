@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace volcano::telnet {
+
+    // The byte encoding a client's text is exchanged in. The game side always
+    // speaks UTF-8; connections transcode app data at the socket boundary.
+    enum class Charset : std::uint8_t {
+        utf8,    // passed through untouched
+        latin1,  // ISO-8859-1
+        cp437,   // IBM PC / DOS
+        ascii,   // 7-bit; anything else becomes '?'
+    };
+
+    // Maps a CHARSET/MTTS encoding name to a Charset. Unknown names pass through as utf8.
+    Charset charset_from_name(std::string_view name);
+
+    // Length of the leading run of 7-bit bytes, scanned a machine word at a time.
+    std::size_t ascii_prefix(std::string_view data);
+
+    // Appends UTF-8 text converted to charset. Characters the charset lacks (and
+    // malformed UTF-8) become '?'. The output is not IAC-escaped.
+    void encode_from_utf8(Charset charset, std::string_view utf8, std::string& out);
+
+    // UTF-8 app text as it goes on the wire to a client using charset: transcoded,
+    // then IAC-escaped once. Returns utf8 itself when neither step changes anything,
+    // otherwise a view of scratch.
+    std::string_view encode_app_data(Charset charset, std::string_view utf8, std::string& scratch);
+
+    // Appends client bytes in charset converted to UTF-8.
+    void decode_to_utf8(Charset charset, std::string_view data, std::string& out);
+
+}
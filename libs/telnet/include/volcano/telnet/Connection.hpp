@@ -1,5 +1,10 @@
 #pragma once
 #include "Base.hpp"
+#include "Charset.hpp"
+#include "LineAssembler.hpp"
+#include "Option.hpp"
+#include "OutgoingQueue.hpp"
+#include "SessionRecording.hpp"
 
 #include "volcano/net/Connection.hpp"
 #include "volcano/mud/ClientData.hpp"
@@ -23,16 +28,16 @@ namespace volcano::telnet {
             return client_data_;
         }
 
-        Channel<TelnetToGameMessage>& to_game_channel() {
+        ToGameQueue& to_game_queue() {
             return *to_game_messages_;
         }
 
-        std::shared_ptr<Channel<TelnetToGameMessage>> to_game_channel_shared() const {
+        std::shared_ptr<ToGameQueue> to_game_queue_shared() const {
             return to_game_messages_;
         }
 
-        std::shared_ptr<Channel<TelnetToTelnetMessage>> to_telnet_channel_shared() const {
-            return to_telnet_messages_;
+        std::shared_ptr<OutgoingQueue> outgoing_queue_shared() const {
+            return outgoing_messages_;
         }
 
         bool is_negotiation_completed() const {
@@ -41,7 +46,7 @@ namespace volcano::telnet {
 
         std::shared_ptr<TelnetLink> make_link() const;
 
-        boost::asio::awaitable<void> sendToClient(const TelnetToTelnetMessage& msg);
+        boost::asio::awaitable<void> sendToClient(TelnetToTelnetMessage msg);
 
         const volcano::net::AnyStream& connection() const {
             return conn_;
@@ -49,24 +54,37 @@ namespace volcano::telnet {
 
         private:
         volcano::net::AnyStream conn_;
-        boost::asio::steady_timer keepalive_timer_;
         volcano::mud::ClientData client_data_;
-        std::vector<std::shared_ptr<Channel<bool>>> pending_channels_;
-        Channel<TelnetOutgoingMessage> outgoing_messages_;
-        std::shared_ptr<Channel<TelnetToTelnetMessage>> to_telnet_messages_;
-        std::shared_ptr<Channel<TelnetToGameMessage>> to_game_messages_;
+        std::shared_ptr<OutgoingQueue> outgoing_messages_;
+        std::shared_ptr<ToGameQueue> to_game_messages_;
         std::atomic<TelnetDisconnect> shutdown_reason_{TelnetDisconnect::error};
-        std::string append_data_buffer_;
+        LineAssembler line_assembler_;
+        // app data is transcoded to and from this at the socket; set from ClientData::encoding.
+        Charset charset_{Charset::utf8};
+        std::string decoded_input_;
         bool telnet_mode{false};
         boost::asio::cancellation_signal cancellation_signal_;
         boost::asio::cancellation_state cancellation_state_;
         bool negotiation_completed_{false};
+        TelnetOptionStates option_states_;
+        // cancelled by completeNegotiation() once the last pending option settles.
+        boost::asio::steady_timer negotiation_timer_;
+        boost::asio::steady_timer congestion_timer_;
+        // only set when telnet_limits.record_directory is configured.
+        std::unique_ptr<SessionRecorder> recorder_;
+
+        void record(RecordKind kind, std::string_view payload) {
+            if(recorder_) {
+                recorder_->record(kind, payload);
+            }
+        }
 
         boost::asio::awaitable<void> runReader();
         boost::asio::awaitable<void> runWriter();
         boost::asio::awaitable<void> runLink();
-        boost::asio::awaitable<void> runOutboundBridge();
-        boost::asio::awaitable<void> runKeepAlive();
+        // under SlowClientPolicy::disconnect, shuts the connection down once the writer queue
+        // has stayed over high_water for OutputLimits::disconnect_after. Runs for the connection's lifetime.
+        boost::asio::awaitable<void> watchCongestion();
 
         boost::asio::awaitable<void> signalShutdown(TelnetDisconnect reason);
         
@@ -78,10 +96,10 @@ namespace volcano::telnet {
         boost::asio::awaitable<void> sendCommand(char command);
         boost::asio::awaitable<void> notifyChangedCapabilities(nlohmann::json& capabilities);
 
-        std::unordered_map<char, std::shared_ptr<TelnetOption>> options_;
+        void completeNegotiation(std::uint16_t bits);
 
         // event handlers
-        boost::asio::awaitable<void> handleAppData(TelnetMessageData& app_data);
+        boost::asio::awaitable<void> handleAppData(std::string_view app_data);
         boost::asio::awaitable<void> handleGMCP(TelnetMessageGMCP& gmcp);
         boost::asio::awaitable<void> handleNegotiate(TelnetMessageNegotiation& negotiation);
         boost::asio::awaitable<void> handleSubNegotiation(TelnetMessageSubnegotiation& subnegotiation);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace volcano::telnet {
+
+    // Turns client app data into lines. Input is appended to one buffer with a
+    // read cursor; completed lines are handed out as views into it and the space
+    // they used is reclaimed by a single compaction on the next feed(), rather
+    // than an erase per line.
+    class LineAssembler {
+        public:
+        explicit LineAssembler(std::size_t limit);
+
+        // Appends data, applying backspace/delete to the line being typed.
+        // Returns false if the unconsumed input exceeds the limit.
+        [[nodiscard]] bool feed(std::string_view data);
+
+        // Next completed line without its line ending. Views stay valid until the next feed().
+        std::optional<std::string_view> next_line();
+
+        [[nodiscard]] std::size_t pending() const {
+            return buffer_.size() - read_;
+        }
+
+        void clear();
+
+        private:
+        std::string buffer_;
+        std::size_t read_{0};        // start of the first line not yet handed out
+        std::size_t line_start_{0};  // start of the line still being typed
+        std::size_t limit_;
+    };
+
+}
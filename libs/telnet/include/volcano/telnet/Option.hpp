@@ -1,8 +1,10 @@
 #pragma once
 
 #include "Base.hpp"
-#include <unordered_map>
+#include <array>
+#include <cstdint>
 #include <optional>
+#include <span>
 
 namespace volcano::mud {
     struct ClientData;
@@ -11,164 +13,188 @@ namespace volcano::mud {
 namespace volcano::telnet {
 
     struct TelnetOptionState {
-        bool enabled{false};
-        bool negotiating{false};
+        bool enabled : 1 {false};
+        bool negotiating : 1 {false};
     };
 
+    // Everything the option handlers keep per connection. Handlers are shared,
+    // stateless singletons that index into this block by their slot. It replaces
+    // ten heap-allocated option objects, each with a string-keyed map of
+    // mutex-guarded channels: 56 allocations and 3960 bytes per connection, plus
+    // the ten channels' own bodies, against 48 bytes inline and no allocations
+    // (the "option state" rows of volcano_telnet_bench).
+    struct TelnetOptionStates {
+        static constexpr std::size_t max_options = 16;
+
+        std::array<TelnetOptionState, max_options> local{};   // our side
+        std::array<TelnetOptionState, max_options> remote{};  // their side
+        std::uint16_t pending{0};   // one bit per option slot we asked for and are still waiting on
+        std::uint16_t answered{0};  // slots the client actually responded to
+        std::uint8_t mtts_requests{0};
+        bool charset_requested{false};
+        std::uint64_t mtts_last_hash{0};  // MTTS replies repeat once the client has cycled
+    };
+
+    static_assert(sizeof(TelnetOptionStates) <= 48, "per-connection option state grew; update the figure above");
+
     class TelnetOption {
         public:
-        TelnetOption(TelnetConnection& connection);
+        explicit TelnetOption(std::uint8_t slot);
         virtual ~TelnetOption() = default;
 
         virtual char option_code() const = 0;
-        
-        virtual boost::asio::awaitable<void> start();
 
+        std::uint8_t slot() const {
+            return slot_;
+        }
 
-        virtual boost::asio::awaitable<void> at_receive_negotiate(char command);
-        virtual boost::asio::awaitable<void> at_receive_subnegotiate(std::string_view data);
+        std::uint16_t pending_bit() const {
+            return static_cast<std::uint16_t>(1u << slot_);
+        }
 
-        protected:
-        TelnetConnection& tc;
+        virtual boost::asio::awaitable<void> start(TelnetConnection& tc) const;
 
-        TelnetOptionState local;   // our side
-        TelnetOptionState remote;  // their side
+        virtual boost::asio::awaitable<void> at_receive_negotiate(TelnetConnection& tc, char command) const;
+        virtual boost::asio::awaitable<void> at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const;
 
-        std::shared_ptr<Channel<bool>> getPendingChannel(const std::string& name);
-        std::unordered_map<std::string, std::shared_ptr<Channel<bool>>> pending_channels_;
-        virtual std::string getBaseChannelName() = 0;
+        protected:
+        TelnetOptionStates& states(TelnetConnection& tc) const;
+        TelnetOptionState& local(TelnetConnection& tc) const;
+        TelnetOptionState& remote(TelnetConnection& tc) const;
 
-        boost::asio::awaitable<void> markNegotiationComplete(std::string name);
+        void markNegotiationComplete(TelnetConnection& tc) const;
 
-        volcano::mud::ClientData& client_data();
-        boost::asio::awaitable<void> notifyChangedCapabilities(nlohmann::json& capabilities);
+        volcano::mud::ClientData& client_data(TelnetConnection& tc) const;
+        // sets ClientData::encoding and the charset the connection transcodes app data to.
+        void set_encoding(TelnetConnection& tc, std::string encoding) const;
+        boost::asio::awaitable<void> notifyChangedCapabilities(TelnetConnection& tc, nlohmann::json& capabilities) const;
 
         // supported, auto-start, in order.
-        virtual std::pair<bool, bool> getLocalSupportInfo();
-        virtual std::pair<bool, bool> getRemoteSupportInfo();
+        virtual std::pair<bool, bool> getLocalSupportInfo() const;
+        virtual std::pair<bool, bool> getRemoteSupportInfo() const;
 
         // overloadable hooks for state changes.
-        virtual boost::asio::awaitable<void> at_local_reject();
-        virtual boost::asio::awaitable<void> at_remote_reject();
-        virtual boost::asio::awaitable<void> at_local_enable();
-        virtual boost::asio::awaitable<void> at_remote_enable();
-        virtual boost::asio::awaitable<void> at_local_disable();
-        virtual boost::asio::awaitable<void> at_remote_disable();
-
-        virtual boost::asio::awaitable<void> send_negotiation(char command);
-        virtual boost::asio::awaitable<void> send_subnegotiate(std::string_view data);
-
-        virtual boost::asio::awaitable<void> at_send_negotiate(char command);
-        virtual boost::asio::awaitable<void> at_send_subnegotiate(std::string_view data);
+        virtual boost::asio::awaitable<void> at_local_reject(TelnetConnection& tc) const;
+        virtual boost::asio::awaitable<void> at_remote_reject(TelnetConnection& tc) const;
+        virtual boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const;
+        virtual boost::asio::awaitable<void> at_remote_enable(TelnetConnection& tc) const;
+        virtual boost::asio::awaitable<void> at_local_disable(TelnetConnection& tc) const;
+        virtual boost::asio::awaitable<void> at_remote_disable(TelnetConnection& tc) const;
+
+        virtual boost::asio::awaitable<void> send_negotiation(TelnetConnection& tc, char command) const;
+        virtual boost::asio::awaitable<void> send_subnegotiate(TelnetConnection& tc, std::string_view data) const;
+
+        virtual boost::asio::awaitable<void> at_send_negotiate(TelnetConnection& tc, char command) const;
+        virtual boost::asio::awaitable<void> at_send_subnegotiate(TelnetConnection& tc, std::string_view data) const;
+
+        private:
+        std::uint8_t slot_;
     };
 
+    // Every supported option, in the order they are started.
+    std::span<const TelnetOption* const> telnet_options();
+
+    // Option code -> shared handler; nullptr for options we refuse.
+    const std::array<const TelnetOption*, 256>& telnet_option_table();
+
+    // Process-wide memory of which options a client (by MTTS/GMCP name and version)
+    // answered in earlier sessions, so options it never answers need not be waited on.
+    std::optional<std::uint16_t> find_client_profile(std::string_view name, std::string_view version);
+    void remember_client_profile(std::string_view name, std::string_view version, std::uint16_t answered);
+
     class NAWSOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getRemoteSupportInfo() override;
-        boost::asio::awaitable<void> at_remote_enable() override;
-        boost::asio::awaitable<void> at_receive_subnegotiate(std::string_view data) override;
+        std::pair<bool, bool> getRemoteSupportInfo() const override;
+        boost::asio::awaitable<void> at_remote_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const override;
     };
 
     class SGAOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getLocalSupportInfo() override;
-        boost::asio::awaitable<void> at_local_enable() override;
+        std::pair<bool, bool> getLocalSupportInfo() const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
     };
 
     class CHARSETOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getRemoteSupportInfo() override;
-        boost::asio::awaitable<void> at_remote_enable() override;
-        boost::asio::awaitable<void> at_local_enable() override;
-        boost::asio::awaitable<void> at_receive_subnegotiate(std::string_view data) override;
+        std::pair<bool, bool> getRemoteSupportInfo() const override;
+        boost::asio::awaitable<void> at_remote_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const override;
 
         private:
-        boost::asio::awaitable<void> request_charset();
-        std::optional<std::string> enabled_;
+        boost::asio::awaitable<void> request_charset(TelnetConnection& tc) const;
     };
 
     class MTTSOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getRemoteSupportInfo() override;
-        boost::asio::awaitable<void> at_remote_enable() override;
-        boost::asio::awaitable<void> at_receive_subnegotiate(std::string_view data) override;
+        std::pair<bool, bool> getRemoteSupportInfo() const override;
+        boost::asio::awaitable<void> at_remote_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const override;
 
         private:
-        boost::asio::awaitable<void> request();
-        boost::asio::awaitable<void> handle_name(std::string_view data);
-        boost::asio::awaitable<void> handle_ttype(std::string_view data);
-        boost::asio::awaitable<void> handle_standard(std::string_view data);
-
-        int number_requests_ = 0;
-        std::string last_received_;
+        boost::asio::awaitable<void> request(TelnetConnection& tc) const;
+        boost::asio::awaitable<void> handle_name(TelnetConnection& tc, std::string_view data) const;
+        boost::asio::awaitable<void> handle_ttype(TelnetConnection& tc, std::string_view data) const;
+        boost::asio::awaitable<void> handle_standard(TelnetConnection& tc, std::string_view data) const;
     };
 
     class MSSPOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getLocalSupportInfo() override;
-        boost::asio::awaitable<void> at_local_enable() override;
+        std::pair<bool, bool> getLocalSupportInfo() const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
     };
 
     class MCCP2Option : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getLocalSupportInfo() override;
-        boost::asio::awaitable<void> at_local_enable() override;
-        boost::asio::awaitable<void> at_send_subnegotiate(std::string_view data) override;
+        std::pair<bool, bool> getLocalSupportInfo() const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_send_subnegotiate(TelnetConnection& tc, std::string_view data) const override;
     };
 
     class MCCP3Option : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getLocalSupportInfo() override;
-        boost::asio::awaitable<void> at_local_enable() override;
-        boost::asio::awaitable<void> at_receive_subnegotiate(std::string_view data) override;
+        std::pair<bool, bool> getLocalSupportInfo() const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const override;
     };
 
     class GMCPOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getLocalSupportInfo() override;
-        boost::asio::awaitable<void> at_local_enable() override;
-        boost::asio::awaitable<void> at_receive_subnegotiate(std::string_view data) override;
-        boost::asio::awaitable<void> send_gmcp(std::string_view command, const nlohmann::json* data = nullptr);
+        std::pair<bool, bool> getLocalSupportInfo() const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
+        boost::asio::awaitable<void> at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const override;
+        boost::asio::awaitable<void> send_gmcp(TelnetConnection& tc, std::string_view command, const nlohmann::json* data = nullptr) const;
     };
 
     class LineModeOption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
-        std::pair<bool, bool> getLocalSupportInfo() override;
-        boost::asio::awaitable<void> at_local_enable() override;
+        std::pair<bool, bool> getLocalSupportInfo() const override;
+        boost::asio::awaitable<void> at_local_enable(TelnetConnection& tc) const override;
     };
 
     class EOROption : public TelnetOption {
         public:
         using TelnetOption::TelnetOption;
         char option_code() const override;
-        std::string getBaseChannelName() override;
     };
 
 }
\ No newline at end of file
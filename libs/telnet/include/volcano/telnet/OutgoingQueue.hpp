@@ -0,0 +1,164 @@
+#pragma once
+#include "Base.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/post.hpp>
+
+namespace volcano::telnet {
+
+    // A point-in-time view of one connection's writer queue.
+    struct OutputQueueStats {
+        std::size_t queued_bytes{0};
+        std::size_t queued_messages{0};
+        std::size_t peak_bytes{0};
+        std::uint64_t dropped_messages{0};
+        std::uint64_t collapsed_messages{0};
+        boost::asio::steady_timer::duration congested_for{};
+    };
+
+    // Totals across every connection's writer queue, for process-wide metrics.
+    struct OutputQueueTotals {
+        std::size_t queued_bytes{0};
+        std::size_t queued_messages{0};
+        std::uint64_t dropped_messages{0};
+        std::uint64_t collapsed_messages{0};
+    };
+
+    OutputQueueTotals output_queue_totals();
+
+    // Byte-accounted writer queue for one connection. Producers push from any thread;
+    // the connection's writer is the only consumer. Once the queued bytes pass
+    // OutputLimits::high_water the configured SlowClientPolicy applies; the writer
+    // sheds messages as it pops them until the queue is back under half of high_water.
+    // Protocol traffic (negotiation, commands, non-GMCP subnegotiation, disconnects)
+    // is never dropped.
+    class OutgoingQueue {
+        public:
+        explicit OutgoingQueue(boost::asio::any_io_executor executor, OutputLimits limits = telnet_limits.output);
+        ~OutgoingQueue();
+
+        OutgoingQueue(const OutgoingQueue&) = delete;
+        OutgoingQueue& operator=(const OutgoingQueue&) = delete;
+
+        // counts_as_activity=false is for keepalive traffic, which shouldn't show up in take_activity().
+        PushResult push(TelnetOutgoingMessage msg, bool counts_as_activity = true);
+        // As push(), but applies hard_limit to text and GMCP under every policy, block included.
+        PushResult try_push(TelnetOutgoingMessage msg);
+
+        // Completes at once while the queue is at or under high_water, or with eof once
+        // it closes. A sender that does have to wait is resumed only when the writer has
+        // drained the queue to half of high_water, so waiters aren't woken one message
+        // at a time while the client hovers around the limit.
+        template<typename CompletionToken>
+        auto async_wait_for_room(CompletionToken&& token) {
+            return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code)>(
+                [this](auto handler) {
+                    auto executor = boost::asio::get_associated_executor(handler, queue_.get_executor());
+                    RoomWaiter resume = [handler = std::move(handler), executor](boost::system::error_code ec) mutable {
+                        boost::asio::post(executor, [handler = std::move(handler), ec]() mutable {
+                            std::move(handler)(ec);
+                        });
+                    };
+
+                    std::unique_lock lock(room_mutex_);
+                    room_waiting_.store(true, std::memory_order_seq_cst);
+                    if(queue_.is_closed()) {
+                        lock.unlock();
+                        resume(boost::asio::error::eof);
+                    } else if(queued_bytes_.load(std::memory_order_seq_cst) <= limits_.high_water) {
+                        lock.unlock();
+                        resume({});
+                    } else {
+                        room_waiters_.push_back(std::move(resume));
+                    }
+                },
+                token);
+        }
+
+        void close();
+
+        bool is_closed() const {
+            return queue_.is_closed();
+        }
+
+        // Consumer only. Returns the next message to write, skipping whatever the policy sheds.
+        boost::asio::awaitable<std::expected<TelnetOutgoingMessage, boost::system::error_code>> receive(boost::asio::cancellation_slot slot = {});
+
+        const OutputLimits& limits() const {
+            return limits_;
+        }
+
+        // How long the queue has been over high_water; zero if it isn't.
+        boost::asio::steady_timer::duration congested_for(boost::asio::steady_timer::time_point now) const;
+
+        OutputQueueStats stats() const;
+
+        // The charset the connection's writer encodes text in, so senders can pre-encode
+        // shared text (TelnetMessageWire) for it. Only advisory: the writer re-checks.
+        Charset charset() const {
+            return charset_.load(std::memory_order_relaxed);
+        }
+        void set_charset(Charset charset) {
+            charset_.store(charset, std::memory_order_relaxed);
+        }
+
+        // Whether anything was pushed since the last call.
+        bool take_activity() {
+            return active_.exchange(false, std::memory_order_relaxed);
+        }
+
+        private:
+        PushResult push(TelnetOutgoingMessage msg, bool counts_as_activity, bool bounded);
+
+        struct Entry {
+            TelnetOutgoingMessage msg;
+            std::size_t bytes{0};
+            // sequence of this GMCP message within its package under collapse_gmcp, otherwise 0.
+            std::uint64_t gmcp_sequence{0};
+        };
+
+        using RoomWaiter = std::move_only_function<void(boost::system::error_code)>;
+
+        bool shed(const Entry& entry);
+        void release(std::size_t bytes);
+        void wake_room_waiters(boost::system::error_code ec);
+
+        OutputLimits limits_;
+        volcano::net::MessageQueue<Entry> queue_;
+
+        std::atomic<std::size_t> queued_bytes_{0};
+        std::atomic<std::size_t> queued_messages_{0};
+        std::atomic<std::size_t> peak_bytes_{0};
+        std::atomic<std::uint64_t> dropped_messages_{0};
+        std::atomic<std::uint64_t> collapsed_messages_{0};
+        // steady_clock ticks when the queue went over high_water; 0 while it is under.
+        std::atomic<boost::asio::steady_timer::duration::rep> congested_since_{0};
+        std::atomic<bool> active_{false};
+        std::atomic<Charset> charset_{Charset::utf8};
+
+        // consumer only: set while draining back down after passing high_water.
+        bool shedding_{false};
+
+        std::mutex room_mutex_;
+        std::atomic<bool> room_waiting_{false};
+        std::vector<RoomWaiter> room_waiters_;
+
+        // newest queued sequence per GMCP package, only kept under collapse_gmcp.
+        std::mutex gmcp_mutex_;
+        std::unordered_map<std::string, std::uint64_t> gmcp_latest_;
+        std::uint64_t gmcp_sequence_{0};
+    };
+
+}
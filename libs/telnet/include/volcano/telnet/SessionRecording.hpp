@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace volcano::telnet {
+
+    // A recording is a RecordingHeader followed by records, each a RecordHeader and
+    // `length` payload bytes. Integers are in host byte order; records are not aligned.
+    enum class RecordKind : std::uint8_t {
+        inbound = 1,        // raw bytes as read from the socket
+        outbound = 2,       // bytes handed to the writer, before MCCP2
+        game_input = 3,     // one line delivered to the game
+        negotiation = 4,    // command byte, option byte
+        subnegotiation = 5, // option byte, then the unescaped body
+        capabilities = 6,   // JSON of a capability change sent to the game
+        disconnect = 7,     // one TelnetDisconnect byte
+    };
+
+    struct RecordingHeader {
+        char magic[4];
+        std::uint16_t version;
+        std::uint16_t reserved;
+        std::int64_t connection_id;
+        std::int64_t started_unix_ns;
+    };
+
+    struct RecordHeader {
+        RecordKind kind;
+        std::uint8_t reserved[3];
+        std::uint32_t length;
+        std::int64_t offset_ns;
+    };
+
+    static_assert(sizeof(RecordingHeader) == 24);
+    static_assert(sizeof(RecordHeader) == 16);
+
+    inline constexpr char recording_magic[4] = {'V', 'R', 'E', 'C'};
+    inline constexpr std::uint16_t recording_version = 1;
+
+    // Appends one connection's traffic to a file. record() only copies into a pending buffer;
+    // a shared background thread does the file I/O so a slow disk never stalls the I/O threads.
+    // Whatever is pending is written out after destruction.
+    class SessionRecorder {
+        public:
+        // nullptr if the file can't be created.
+        static std::unique_ptr<SessionRecorder> open(const std::filesystem::path& path, std::int64_t connection_id);
+
+        ~SessionRecorder();
+
+        SessionRecorder(const SessionRecorder&) = delete;
+        SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+        void record(RecordKind kind, std::string_view payload);
+
+        struct Sink;
+
+        private:
+        explicit SessionRecorder(std::shared_ptr<Sink> sink);
+
+        std::shared_ptr<Sink> sink_;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    struct RecordView {
+        RecordKind kind;
+        std::chrono::nanoseconds offset;
+        std::string_view payload;
+    };
+
+    // A recording mapped read-only into memory (read into a heap buffer on Windows).
+    // Record payloads are views into that storage.
+    class SessionRecording {
+        public:
+        static std::expected<SessionRecording, std::string> open(const std::filesystem::path& path);
+
+        SessionRecording(SessionRecording&& other) noexcept;
+        SessionRecording& operator=(SessionRecording&& other) noexcept;
+        ~SessionRecording();
+
+        const RecordingHeader& header() const {
+            return header_;
+        }
+
+        // Every complete record in file order; a truncated tail (e.g. after a crash) is ignored.
+        std::vector<RecordView> records() const;
+
+        private:
+        SessionRecording(const char* data, std::size_t size);
+
+        const char* data_{nullptr};
+        std::size_t size_{0};
+        RecordingHeader header_{};
+    };
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Wire-level encoding and decoding used by TelnetConnection. Internal to the
+// library (not installed); exposed here so the codec bench can drive it directly.
+
+#include "volcano/telnet/Base.hpp"
+
+#include <cstddef>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace volcano::telnet {
+
+    // Parses one message from the front of data and returns it with the number of
+    // bytes it used. Fails when data holds only an incomplete IAC sequence.
+    std::expected<std::pair<TelnetMessage, size_t>, std::string> parseTelnetMessage(std::string_view data);
+
+    // Appends IAC SB <option> <escaped data> IAC SE.
+    void append_subnegotiation(std::string& out, char option, std::string_view data);
+
+    // Wire bytes for msg, with app data IAC-escaped. The second form appends to out.
+    std::string encodeTelnetMessage(const TelnetMessage& msg);
+    void encodeTelnetMessage(const TelnetMessage& msg, std::string& out);
+
+    // App data is returned straight from the message, unescaped, for the writer to transcode
+    // and escape; only protocol messages are encoded into scratch.
+    std::string_view messagePayload(const TelnetMessage& msg, std::string& scratch);
+
+    // Splits a GMCP body into its package name and (possibly empty) JSON text.
+    std::pair<std::string_view, std::string_view> splitGMCP(std::string_view data);
+
+}
@@ -1,9 +1,22 @@
 #include "volcano/telnet/Base.hpp"
+#include "volcano/telnet/OutgoingQueue.hpp"
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
 namespace volcano::telnet {
 
 	TelnetLimits telnet_limits;
 
+	void append_iac_escaped(std::string& out, std::string_view data) {
+		for (char ch : data) {
+			out.push_back(ch);
+			if (ch == codes::IAC) {
+				out.push_back(codes::IAC);
+			}
+		}
+	}
+
 	TelnetMessageSubnegotiation TelnetMessageGMCP::toSubnegotiation() const {
 		TelnetMessageSubnegotiation out;
 		out.option = codes::GMCP;
@@ -15,6 +28,42 @@ namespace volcano::telnet {
 		return out;
 	}
 
+	nlohmann::json TelnetReceivedGMCP::data() const {
+		if (payload.empty()) {
+			return nullptr;
+		}
+		auto parsed = nlohmann::json::parse(payload, nullptr, false);
+		if (parsed.is_discarded()) {
+			return nullptr;
+		}
+		return parsed;
+	}
+
+	std::shared_ptr<const PreparedGMCP> prepareGMCP(std::string package, std::string_view json_text) {
+		auto out = std::make_shared<PreparedGMCP>();
+		out->frame.reserve(package.size() + json_text.size() + 6);
+		out->frame.push_back(codes::IAC);
+		out->frame.push_back(codes::SB);
+		out->frame.push_back(codes::GMCP);
+		append_iac_escaped(out->frame, package);
+		if (!json_text.empty()) {
+			out->frame.push_back(' ');
+			append_iac_escaped(out->frame, json_text);
+		}
+		out->frame.push_back(codes::IAC);
+		out->frame.push_back(codes::SE);
+		out->package = std::move(package);
+		return out;
+	}
+
+	std::shared_ptr<const PreparedGMCP> prepareGMCP(std::string package, const nlohmann::json& data) {
+		if (data.is_null()) {
+			return prepareGMCP(std::move(package), std::string_view{});
+		}
+		const auto text = data.dump();
+		return prepareGMCP(std::move(package), std::string_view(text));
+	}
+
 	TelnetMessageSubnegotiation TelnetMessageMSSP::toSubnegotiation() const {
 		TelnetMessageSubnegotiation out;
 		out.option = codes::MSSP;
@@ -28,4 +77,46 @@ namespace volcano::telnet {
 		out.data = std::move(payload);
 		return out;
 	}
-}
\ No newline at end of file
+
+	TelnetOutgoingMessage toOutgoingMessage(TelnetToTelnetMessage msg) {
+		if (std::holds_alternative<TelnetDisconnect>(msg)) {
+			return std::get<TelnetDisconnect>(msg);
+		}
+		return std::visit([](auto&& m) -> TelnetOutgoingMessage {
+			using T = std::decay_t<decltype(m)>;
+			if constexpr (std::is_same_v<T, TelnetMessageGMCP> || std::is_same_v<T, TelnetMessageMSSP>) {
+				return TelnetMessage{m.toSubnegotiation()};
+			} else {
+				return TelnetMessage{std::move(m)};
+			}
+		}, std::move(std::get<TelnetClientMessage>(msg)));
+	}
+
+	PushResult TelnetLink::send(TelnetToTelnetMessage msg) const {
+		if (!to_telnet) {
+			return PushResult::closed;
+		}
+		return to_telnet->push(toOutgoingMessage(std::move(msg)));
+	}
+
+	PushResult TelnetLink::try_send(TelnetToTelnetMessage msg) const {
+		if (!to_telnet) {
+			return PushResult::closed;
+		}
+		return to_telnet->try_push(toOutgoingMessage(std::move(msg)));
+	}
+
+	boost::asio::awaitable<PushResult> TelnetLink::async_send(TelnetToTelnetMessage msg) const {
+		if (!to_telnet) {
+			co_return PushResult::closed;
+		}
+		if (to_telnet->limits().policy == SlowClientPolicy::block) {
+			boost::system::error_code ec;
+			co_await to_telnet->async_wait_for_room(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+			if (ec) {
+				co_return PushResult::closed;
+			}
+		}
+		co_return to_telnet->push(toOutgoingMessage(std::move(msg)));
+	}
+}
@@ -0,0 +1,231 @@
+#include "volcano/telnet/Charset.hpp"
+#include "volcano/telnet/Base.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
+
+namespace volcano::telnet {
+
+    namespace {
+        // code points for CP437 bytes 0x80-0xFF.
+        constexpr std::array<char16_t, 128> cp437_high = {
+            0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+            0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+            0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+            0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+            0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+            0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+            0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+            0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+        };
+
+        constexpr char32_t invalid = 0xFFFFFFFF;
+
+        // UTF-8 encodings of the high half of a single-byte charset, built once.
+        struct Utf8Seq {
+            char bytes[3];
+            std::uint8_t length;
+        };
+        using DecodeTable = std::array<Utf8Seq, 128>;
+
+        Utf8Seq to_utf8(char32_t cp) {
+            if (cp < 0x80) {
+                return {{static_cast<char>(cp)}, 1};
+            }
+            if (cp < 0x800) {
+                return {{static_cast<char>(0xC0 | (cp >> 6)), static_cast<char>(0x80 | (cp & 0x3F))}, 2};
+            }
+            return {{static_cast<char>(0xE0 | (cp >> 12)), static_cast<char>(0x80 | ((cp >> 6) & 0x3F)),
+                     static_cast<char>(0x80 | (cp & 0x3F))}, 3};
+        }
+
+        const DecodeTable& decode_table(Charset charset) {
+            static const auto tables = [] {
+                std::array<DecodeTable, 3> out{};
+                for (std::size_t i = 0; i < 128; ++i) {
+                    out[0][i] = to_utf8(static_cast<char32_t>(0x80 + i));
+                    out[1][i] = to_utf8(cp437_high[i]);
+                    out[2][i] = to_utf8(U'?');
+                }
+                return out;
+            }();
+            switch (charset) {
+                case Charset::latin1: return tables[0];
+                case Charset::cp437: return tables[1];
+                default: return tables[2];
+            }
+        }
+
+        // code point -> CP437 byte, sorted by code point for binary search.
+        const std::array<std::pair<char16_t, char>, 128>& cp437_reverse() {
+            static const auto table = [] {
+                std::array<std::pair<char16_t, char>, 128> out{};
+                for (std::size_t i = 0; i < 128; ++i) {
+                    out[i] = {cp437_high[i], static_cast<char>(0x80 + i)};
+                }
+                std::sort(out.begin(), out.end());
+                return out;
+            }();
+            return table;
+        }
+
+        char encode_one(Charset charset, char32_t cp) {
+            switch (charset) {
+                case Charset::latin1:
+                    return cp < 0x100 ? static_cast<char>(cp) : '?';
+                case Charset::cp437: {
+                    const auto& table = cp437_reverse();
+                    auto it = std::lower_bound(table.begin(), table.end(), std::pair<char16_t, char>{static_cast<char16_t>(cp), 0},
+                        [](const auto& a, const auto& b) { return a.first < b.first; });
+                    return cp <= 0xFFFF && it != table.end() && it->first == cp ? it->second : '?';
+                }
+                default:
+                    return '?';
+            }
+        }
+
+        // Decodes the multi-byte sequence at the front of data. Returns the code
+        // point (invalid for malformed input) and how many bytes it used.
+        std::pair<char32_t, std::size_t> next_code_point(std::string_view data) {
+            const auto lead = static_cast<unsigned char>(data[0]);
+            std::size_t length;
+            char32_t cp;
+            if ((lead & 0xE0) == 0xC0) {
+                length = 2;
+                cp = lead & 0x1F;
+            } else if ((lead & 0xF0) == 0xE0) {
+                length = 3;
+                cp = lead & 0x0F;
+            } else if ((lead & 0xF8) == 0xF0) {
+                length = 4;
+                cp = lead & 0x07;
+            } else {
+                return {invalid, 1};
+            }
+            if (data.size() < length) {
+                return {invalid, 1};
+            }
+            for (std::size_t i = 1; i < length; ++i) {
+                const auto next = static_cast<unsigned char>(data[i]);
+                if ((next & 0xC0) != 0x80) {
+                    return {invalid, 1};
+                }
+                cp = (cp << 6) | (next & 0x3F);
+            }
+            static constexpr char32_t min_for_length[] = {0, 0, 0x80, 0x800, 0x10000};
+            if (cp < min_for_length[length] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                return {invalid, length};
+            }
+            return {cp, length};
+        }
+    }
+
+    Charset charset_from_name(std::string_view name) {
+        for (auto latin1 : {"iso-8859-1", "iso8859-1", "latin1", "latin-1"}) {
+            if (boost::iequals(name, latin1)) {
+                return Charset::latin1;
+            }
+        }
+        for (auto cp437 : {"cp437", "ibm437"}) {
+            if (boost::iequals(name, cp437)) {
+                return Charset::cp437;
+            }
+        }
+        if (boost::iequals(name, "ascii") || boost::iequals(name, "us-ascii")) {
+            return Charset::ascii;
+        }
+        return Charset::utf8;
+    }
+
+    std::size_t ascii_prefix(std::string_view data) {
+        constexpr std::uint64_t high_bits = 0x8080808080808080ull;
+        std::size_t pos = 0;
+        for (; pos + sizeof(std::uint64_t) <= data.size(); pos += sizeof(std::uint64_t)) {
+            std::uint64_t word;
+            std::memcpy(&word, data.data() + pos, sizeof(word));
+            if (word & high_bits) {
+                break;
+            }
+        }
+        while (pos < data.size() && static_cast<unsigned char>(data[pos]) < 0x80) {
+            ++pos;
+        }
+        return pos;
+    }
+
+    void encode_from_utf8(Charset charset, std::string_view utf8, std::string& out) {
+        if (charset == Charset::utf8) {
+            out.append(utf8);
+            return;
+        }
+        out.reserve(out.size() + utf8.size());
+        while (!utf8.empty()) {
+            const auto run = ascii_prefix(utf8);
+            out.append(utf8.data(), run);
+            utf8.remove_prefix(run);
+            if (utf8.empty()) {
+                break;
+            }
+
+            const auto [cp, used] = next_code_point(utf8);
+            utf8.remove_prefix(used);
+            out.push_back(cp == invalid ? '?' : encode_one(charset, cp));
+        }
+    }
+
+    std::string_view encode_app_data(Charset charset, std::string_view utf8, std::string& scratch) {
+        if (charset == Charset::utf8 || ascii_prefix(utf8) == utf8.size()) {
+            // IAC is not ASCII and never valid UTF-8, so this is rare.
+            if (utf8.find(codes::IAC) == std::string_view::npos) {
+                return utf8;
+            }
+            scratch.clear();
+            append_iac_escaped(scratch, utf8);
+            return scratch;
+        }
+
+        scratch.clear();
+        encode_from_utf8(charset, utf8, scratch);
+        // double IAC in place, back to front, so transcoding needs no second buffer.
+        const auto iacs = static_cast<std::size_t>(std::ranges::count(scratch, codes::IAC));
+        if (iacs != 0) {
+            std::size_t from = scratch.size();
+            scratch.resize(scratch.size() + iacs);
+            std::size_t to = scratch.size();
+            while (from != 0) {
+                const char ch = scratch[--from];
+                scratch[--to] = ch;
+                if (ch == codes::IAC) {
+                    scratch[--to] = ch;
+                }
+            }
+        }
+        return scratch;
+    }
+
+    void decode_to_utf8(Charset charset, std::string_view data, std::string& out) {
+        if (charset == Charset::utf8) {
+            out.append(data);
+            return;
+        }
+        const auto& table = decode_table(charset);
+        out.reserve(out.size() + data.size());
+        while (!data.empty()) {
+            const auto run = ascii_prefix(data);
+            out.append(data.data(), run);
+            data.remove_prefix(run);
+            if (data.empty()) {
+                break;
+            }
+
+            const auto& seq = table[static_cast<unsigned char>(data.front()) - 0x80];
+            out.append(seq.bytes, seq.length);
+            data.remove_prefix(1);
+        }
+    }
+
+}
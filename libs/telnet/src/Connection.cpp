@@ -1,12 +1,27 @@
 #include "volcano/telnet/Connection.hpp"
 #include "volcano/telnet/Option.hpp"
+#include "Codec.hpp"
 #include "volcano/log/Log.hpp"
 #include "volcano/zlib/Zlib.hpp"
 #include "volcano/net/net.hpp"
+#include "volcano/util/BufferPool.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <span>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 #include <boost/algorithm/string.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
@@ -17,210 +32,215 @@
 
 namespace volcano::telnet {
 
-    static std::expected<std::pair<TelnetMessage, size_t>, std::string> parseTelnetMessage(std::string_view data)
-    {
-        if (data.empty())
-        {
-            return std::unexpected("No data to parse");
+    TelnetConnection::TelnetConnection(volcano::net::AnyStream connection)
+        : conn_(std::move(connection)),
+        outgoing_messages_(std::make_shared<OutgoingQueue>(conn_.get_executor())),
+        to_game_messages_(std::make_shared<ToGameQueue>(conn_.get_executor())),
+        line_assembler_(telnet_limits.max_appdata_buffer),
+        negotiation_timer_(conn_.get_executor()),
+        congestion_timer_(conn_.get_executor()) {
+            client_data_.tls = conn_.is_tls();
+            client_data_.client_protocol = "telnet";
+            cancellation_state_ = boost::asio::cancellation_state(cancellation_signal_.slot());
+            if(!telnet_limits.record_directory.empty()) {
+                const auto started = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                const auto path = telnet_limits.record_directory / fmt::format("{}-{}.vrec", conn_.id(), started);
+                recorder_ = SessionRecorder::open(path, conn_.id());
+                if(!recorder_) {
+                    LERROR("Could not open session recording {}", path.string());
+                }
+            }
         }
 
-        auto avail = data.size();
+    namespace {
+        // connection buffers draw from the shared size-class pool, so their footprint shows up in buffer_pool_stats().
+        using PooledFlatBuffer = boost::beast::basic_flat_buffer<volcano::util::PoolAllocator<char>>;
 
-        if (data[0] == codes::IAC)
-        {
-            // we're doing an IAC sequence.
-            if (avail < 2)
-            {
-                return std::unexpected("Incomplete IAC sequence - need at least 2 bytes");
+        // an empty buffer that grew for one oversized message gives the memory back.
+        void release_if_oversized(PooledFlatBuffer& buffer) {
+            if(buffer.size() == 0 && buffer.capacity() > telnet_limits.idle_buffer_capacity) {
+                buffer.shrink_to_fit();
             }
+        }
 
-            switch (data[1])
-            {
-            case codes::WILL:
-            case codes::WONT:
-            case codes::DO:
-            case codes::DONT:
-            {
-                if (avail < 3)
-                {
-                    return std::unexpected("Incomplete negotiation sequence - need at least 3 bytes");
+        std::span<const std::byte> buffer_as_bytes(const PooledFlatBuffer& buffer) {
+            auto data = buffer.data();
+            return {
+                reinterpret_cast<const std::byte*>(data.data()),
+                data.size()
+            };
+        }
+
+        void enable_tcp_keepalive(volcano::net::AnyStream& conn) {
+            const auto& options = telnet_limits.keepalive;
+            if(!options.tcp_keepalive) {
+                return;
+            }
+            auto& socket = conn.lowest_layer();
+            boost::system::error_code ec;
+            socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+            if(ec) {
+                LERROR("{} could not enable TCP keepalive: {}", conn, ec.message());
+                return;
+            }
+#if !defined(_WIN32) && defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+            // asio has no public option types for these, so they go straight to the socket.
+            const auto set_tcp_option = [&](int name, const char* label, int value) {
+                if(::setsockopt(socket.native_handle(), IPPROTO_TCP, name, &value, sizeof(value)) != 0) {
+                    LERROR("{} could not set {}: {}", conn, label, std::strerror(errno));
+                }
+            };
+            set_tcp_option(TCP_KEEPIDLE, "TCP_KEEPIDLE", static_cast<int>(options.tcp_idle.count()));
+            set_tcp_option(TCP_KEEPINTVL, "TCP_KEEPINTVL", static_cast<int>(options.tcp_interval.count()));
+            set_tcp_option(TCP_KEEPCNT, "TCP_KEEPCNT", options.tcp_count);
+#endif
+        }
+
+        // One timer for every linked telnet connection. Each sweep sends IAC NOP to the
+        // queues that were given nothing since the previous sweep; busy connections are skipped.
+        class NopSweeper {
+            public:
+            void add(std::weak_ptr<OutgoingQueue> queue) {
+                std::lock_guard lock(mutex_);
+                queues_.push_back(std::move(queue));
+                if(!running_) {
+                    running_ = true;
+                    boost::asio::co_spawn(boost::asio::make_strand(volcano::net::context()), run(), boost::asio::detached);
                 }
-                TelnetMessage msg = TelnetMessageNegotiation{data[1], data[2]};
-                return std::make_pair(msg, 3);
             }
 
-            case codes::SB:
-            {
-                // subnegotiation: IAC SB <op> [<data>] IAC SE
-                if (avail < 5)
-                {
-                    return std::unexpected("Incomplete subnegotiation sequence - need at least 5 bytes");
+            private:
+            boost::asio::awaitable<void> run() {
+                boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor);
+                for(;;) {
+                    timer.expires_after(telnet_limits.keepalive.nop_interval);
+                    boost::system::error_code ec;
+                    co_await timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                    if(ec || !sweep()) {
+                        co_return;
+                    }
                 }
-                auto op = data[2];
-                // we know that we start with IAC SB <op>... now we need to scan until we find an unescaped IAC SE
-                size_t pos = 3;
-                while (pos + 1 < avail)
+            }
+
+            // returns false (and stops the sweeper) once nothing is left to watch.
+            bool sweep() {
+                std::vector<std::shared_ptr<OutgoingQueue>> idle;
                 {
-                    if (data[pos] == codes::IAC)
-                    {
-                        if (data[pos + 1] == codes::SE)
-                        {
-                            // end of subnegotiation
-                            std::string sub_data;
-                            if (pos > 3)
-                            {
-                                sub_data.reserve(pos - 3);
-                                size_t i = 3;
-                                while (i < pos) {
-                                    if (data[i] == codes::IAC && i + 1 < pos && data[i + 1] == codes::IAC) {
-                                        sub_data.push_back(codes::IAC);
-                                        i += 2;
-                                    } else {
-                                        sub_data.push_back(data[i]);
-                                        i += 1;
-                                    }
-                                }
-                            }
-                            auto translated = TelnetMessageSubnegotiation{op, sub_data};
-                            return std::make_pair(translated, pos + 2);
-                        }
-                        else if (data[pos + 1] == codes::IAC)
-                        {
-                            // escaped 255 byte, skip it
-                            pos += 2;
+                    std::lock_guard lock(mutex_);
+                    std::erase_if(queues_, [&](const std::weak_ptr<OutgoingQueue>& weak) {
+                        auto queue = weak.lock();
+                        if(!queue || queue->is_closed()) {
+                            return true;
                         }
-                        else
-                        {
-                            // something else - just continue
-                            pos += 1;
+                        if(!queue->take_activity()) {
+                            idle.push_back(std::move(queue));
                         }
-                    }
-                    else
-                    {
-                        pos += 1;
+                        return false;
+                    });
+                    if(queues_.empty()) {
+                        running_ = false;
+                        return false;
                     }
                 }
-                return std::unexpected("Incomplete subnegotiation sequence - missing IAC SE terminator");
-            }
-            case codes::IAC:
-            {
-                // escaped 255 data byte
-                TelnetMessage msg = TelnetMessageData{std::string(1, codes::IAC)};
-                return std::make_pair(msg, 2);
-            }
-            default:
-            {
-                // command
-                TelnetMessage msg = TelnetMessageCommand{data[1]};
-                return std::make_pair(msg, 2);
-            }
-            }
-        }
-        else
-        {
-            // regular data
-            size_t pos = data.find(codes::IAC);
-            if (pos == std::string_view::npos)
-            {
-                pos = data.size();
+                // activity was already taken above; the NOP itself doesn't count as traffic for the next sweep.
+                for(auto& queue : idle) {
+                    queue->push(TelnetMessage{TelnetMessageCommand{codes::NOP}}, false);
+                }
+                return true;
             }
-            TelnetMessage msg = TelnetMessageData{std::string(data.substr(0, pos))};
-            return std::make_pair(msg, pos);
-        }
-    }
 
-    static void append_iac_escaped(std::string& out, std::string_view data) {
-        for (char ch : data) {
-            out.push_back(ch);
-            if (static_cast<unsigned char>(ch) == static_cast<unsigned char>(codes::IAC)) {
-                out.push_back(codes::IAC);
-            }
-        }
-    }
+            std::mutex mutex_;
+            std::vector<std::weak_ptr<OutgoingQueue>> queues_;
+            bool running_{false};
+        };
 
-    static void append_subnegotiation(std::string& out, char option, std::string_view data) {
-        out.push_back(codes::IAC);
-        out.push_back(codes::SB);
-        out.push_back(option);
-        append_iac_escaped(out, data);
-        out.push_back(codes::IAC);
-        out.push_back(codes::SE);
-    }
+        NopSweeper& nop_sweeper() {
+            static NopSweeper sweeper;
+            return sweeper;
+        }
 
-    static std::string encodeTelnetMessage(const TelnetMessage& msg) {
-        return std::visit([](const auto& m) -> std::string {
-            using T = std::decay_t<decltype(m)>;
-            std::string out;
-
-            if constexpr (std::is_same_v<T, TelnetMessageData>) {
-                out = m.data;
-            } else if constexpr (std::is_same_v<T, TelnetMessageNegotiation>) {
-                out.push_back(codes::IAC);
-                out.push_back(m.command);
-                out.push_back(m.option);
-            } else if constexpr (std::is_same_v<T, TelnetMessageCommand>) {
-                out.push_back(codes::IAC);
-                out.push_back(m.command);
-            } else if constexpr (std::is_same_v<T, TelnetMessageSubnegotiation>) {
-                append_subnegotiation(out, m.option, m.data);
-            }
-
-            return out;
-        }, msg);
-    }
+        // Tracks how well MCCP2 is doing for one connection and decides when the
+        // deflate level should move. Evaluated once per profile.sample_bytes of input.
+        class Mccp2Tuner {
+            public:
+            explicit Mccp2Tuner(const CompressionProfile& profile)
+                : profile_(profile),
+                  max_level_(profile.deflate.level == Z_DEFAULT_COMPRESSION ? 6 : profile.deflate.level),
+                  level_(max_level_) {}
 
-    TelnetConnection::TelnetConnection(volcano::net::AnyStream connection)
-        : conn_(std::move(connection)), keepalive_timer_(conn_.get_executor()),
-        outgoing_messages_(conn_.get_executor(), 100),
-        to_telnet_messages_(std::make_shared<Channel<TelnetToTelnetMessage>>(conn_.get_executor(), 100)),
-        to_game_messages_(std::make_shared<Channel<TelnetToGameMessage>>(conn_.get_executor(), 100)) {
-            client_data_.tls = conn_.is_tls();
-            client_data_.client_protocol = "telnet";
-            cancellation_state_ = boost::asio::cancellation_state(cancellation_signal_.slot());
-
-            options_.emplace(codes::SGA, std::make_shared<SGAOption>(*this));
-            options_.emplace(codes::NAWS, std::make_shared<NAWSOption>(*this));
-            options_.emplace(codes::CHARSET, std::make_shared<CHARSETOption>(*this));
-            options_.emplace(codes::MTTS, std::make_shared<MTTSOption>(*this));
-            options_.emplace(codes::MSSP, std::make_shared<MSSPOption>(*this));
-            options_.emplace(codes::MCCP2, std::make_shared<MCCP2Option>(*this));
-            options_.emplace(codes::MCCP3, std::make_shared<MCCP3Option>(*this));
-            options_.emplace(codes::GMCP, std::make_shared<GMCPOption>(*this));
-            options_.emplace(codes::LINEMODE, std::make_shared<LineModeOption>(*this));
-            options_.emplace(codes::TELOPT_EOR, std::make_shared<EOROption>(*this));
+            int level() const {
+                return level_;
+            }
 
-        }
+            void set_level(int level) {
+                level_ = level;
+            }
 
-    namespace {
-        std::span<const std::byte> buffer_as_bytes(const boost::beast::flat_buffer& buffer) {
-            auto data = buffer.data();
-            return {
-                reinterpret_cast<const std::byte*>(data.data()),
-                data.size()
-            };
-        }
+            std::optional<int> record(std::size_t in, std::size_t out, std::chrono::steady_clock::duration elapsed) {
+                if(!profile_.adaptive) {
+                    return std::nullopt;
+                }
+                bytes_in_ += in;
+                bytes_out_ += out;
+                elapsed_ += elapsed;
+                if(bytes_in_ < profile_.sample_bytes) {
+                    return std::nullopt;
+                }
 
-        void append_bytes(boost::beast::flat_buffer& buffer, std::span<const std::byte> chunk) {
-            if (chunk.empty()) {
-                return;
+                const double ratio = static_cast<double>(bytes_out_) / static_cast<double>(bytes_in_);
+                const auto cost_per_kib = elapsed_ * 1024 / bytes_in_;
+                bytes_in_ = 0;
+                bytes_out_ = 0;
+                elapsed_ = {};
+
+                int next = level_;
+                if(ratio > profile_.poor_ratio || cost_per_kib > profile_.cost_per_kib_budget) {
+                    next = std::max(profile_.min_level, level_ - 1);
+                } else if(cost_per_kib * 2 < profile_.cost_per_kib_budget) {
+                    next = std::min(max_level_, level_ + 1);
+                }
+                if(next == level_) {
+                    return std::nullopt;
+                }
+                level_ = next;
+                return level_;
             }
-            auto out = buffer.prepare(chunk.size());
-            std::memcpy(out.data(), chunk.data(), chunk.size());
-            buffer.commit(chunk.size());
-        }
+
+            private:
+            const CompressionProfile& profile_;
+            int max_level_;
+            int level_;
+            std::size_t bytes_in_{0};
+            std::size_t bytes_out_{0};
+            std::chrono::steady_clock::duration elapsed_{};
+        };
     }
 
     boost::asio::awaitable<void> TelnetConnection::runReader() {
 
-        bool decompressing = false;
-        volcano::zlib::InflateStream inflater;
-        boost::beast::flat_buffer buffer, decompressed_buffer;
+        // created when MCCP3 starts; inflates straight into decompressed_buffer, which the parser reads from.
+        std::optional<volcano::zlib::InflateStream> inflater;
+        PooledFlatBuffer buffer, decompressed_buffer;
+
+        auto inflate_pending = [&]() -> bool {
+            try {
+                inflater->write_to(buffer_as_bytes(buffer), decompressed_buffer);
+                buffer.consume(buffer.size());
+            } catch (const std::exception& e) {
+                LERROR("{} zlib inflate error {}", *this, e.what());
+                return false;
+            }
+            return true;
+        };
 
         while(true) {
             // we need to grab as many bytes as are available but not wait for more than that.
             if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
                 co_return;
             }
+            release_if_oversized(buffer);
+            release_if_oversized(decompressed_buffer);
             boost::system::error_code read_ec;
             auto prepared = buffer.prepare(4096);
             std::size_t read_bytes = co_await conn_.async_read_some(
@@ -238,33 +258,21 @@ namespace volcano::telnet {
                 co_return;
             }
             buffer.commit(read_bytes);
+            record(RecordKind::inbound, {static_cast<const char*>(prepared.data()), read_bytes});
             if(buffer.size() == 0) {
                 continue;
             }
 
-            if(decompressing) {
-                bool zlib_error = false;
-                try {
-                    auto input = buffer_as_bytes(buffer);
-                    inflater.write(input, [&](std::span<const std::byte> chunk) {
-                        append_bytes(decompressed_buffer, chunk);
-                    });
-                    buffer.consume(buffer.size());
-                } catch (const std::exception& e) {
-                    LERROR("{} zlib inflate error {}", *this, e.what());
-                    zlib_error = true;
-                }
-                if(zlib_error) {
-                    co_await signalShutdown(TelnetDisconnect::error);
-                    co_return;
-                }
+            if(inflater && !inflate_pending()) {
+                co_await signalShutdown(TelnetDisconnect::error);
+                co_return;
             }
 
             for(;;) {
                 if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
                     co_return;
                 }
-                boost::beast::flat_buffer& use_buffer = decompressing ? decompressed_buffer : buffer;
+                PooledFlatBuffer& use_buffer = inflater ? decompressed_buffer : buffer;
 
                 if(use_buffer.size() == 0) {
                     break;
@@ -276,12 +284,21 @@ namespace volcano::telnet {
                     co_return;
                 }
 
-                auto parsed = parseTelnetMessage(
-                    std::string_view{
-                        static_cast<const char*>(use_buffer.data().data()),
-                        use_buffer.size()
-                    }
-                );
+                std::string_view pending{
+                    static_cast<const char*>(use_buffer.data().data()),
+                    use_buffer.size()
+                };
+
+                // plain data goes to the line assembler as a view into the read buffer
+                // rather than being copied into a TelnetMessageData first.
+                if(pending.front() != codes::IAC) {
+                    auto run = pending.substr(0, pending.find(codes::IAC));
+                    co_await handleAppData(run);
+                    use_buffer.consume(run.size());
+                    continue;
+                }
+
+                auto parsed = parseTelnetMessage(pending);
 
                 if(!parsed) {
                     break;
@@ -294,7 +311,7 @@ namespace volcano::telnet {
 
                 if(std::holds_alternative<TelnetMessageSubnegotiation>(msg)) {
                     auto& sub = std::get<TelnetMessageSubnegotiation>(msg);
-                    if(sub.option == codes::MCCP3 && !decompressing) {
+                    if(sub.option == codes::MCCP3 && !inflater) {
                         enable_mccp3 = true;
                     }
                 }
@@ -305,25 +322,11 @@ namespace volcano::telnet {
                     nlohmann::json capabilities;
                     capabilities["mccp3_enabled"] = true;
                     co_await notifyChangedCapabilities(capabilities);
-                    decompressing = true;
-                    inflater.reset();
-
-                    if(buffer.size() > 0) {
-                        bool zlib_error = false;
-                        try {
-                            auto input = buffer_as_bytes(buffer);
-                            inflater.write(input, [&](std::span<const std::byte> chunk) {
-                                append_bytes(decompressed_buffer, chunk);
-                            });
-                            buffer.consume(buffer.size());
-                        } catch (const std::exception& e) {
-                            LERROR("{} zlib inflate error {}", *this, e.what());
-                            zlib_error = true;
-                        }
-                        if(zlib_error) {
-                            co_await signalShutdown(TelnetDisconnect::error);
-                            co_return;
-                        }
+                    inflater.emplace();
+
+                    if(buffer.size() > 0 && !inflate_pending()) {
+                        co_await signalShutdown(TelnetDisconnect::error);
+                        co_return;
                     }
                 }
             }
@@ -336,6 +339,18 @@ namespace volcano::telnet {
     boost::asio::awaitable<void> TelnetConnection::runLink() {
         co_await negotiateOptions();
         negotiation_completed_ = true;
+        // the client may have gone during negotiation; a link now would reach the game dead.
+        if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
+            co_return;
+        }
+
+        if(telnet_mode && client_data_.client_name != "UNKNOWN") {
+            remember_client_profile(client_data_.client_name, client_data_.client_version, option_states_.answered);
+        }
+
+        if(telnet_mode && telnet_limits.keepalive.nop_interval > boost::asio::steady_timer::duration::zero()) {
+            nop_sweeper().add(outgoing_messages_);
+        }
 
         auto link = make_link();
         boost::system::error_code link_ec;
@@ -347,54 +362,28 @@ namespace volcano::telnet {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetConnection::runOutboundBridge() {
-        for(;;) {
-            if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
-                co_return;
-            }
-            boost::system::error_code ec;
-            auto msg = co_await to_telnet_messages_->async_receive(
-                boost::asio::bind_cancellation_slot(
-                    cancellation_state_.slot(),
-                    boost::asio::redirect_error(boost::asio::use_awaitable, ec))
-            );
-            if(ec) {
-                if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
-                    co_return;
-                }
-                LERROR("{} outbound bridge error: {}", *this, ec.message());
-                co_await signalShutdown(TelnetDisconnect::error);
-                co_return;
-            }
-
-            co_await sendToClient(msg);
-        }
-        co_return;
-    }
-
     boost::asio::awaitable<void> TelnetConnection::runWriter() {
-        bool compressing = false;
-        volcano::zlib::DeflateStream deflater(Z_BEST_COMPRESSION);
-        boost::beast::flat_buffer buffer, compressed_buffer;
+        // the deflater only exists once MCCP2 starts, so uncompressed clients carry no zlib state.
+        std::optional<volcano::zlib::DeflateStream> deflater;
+        std::optional<Mccp2Tuner> tuner;
+        PooledFlatBuffer compressed_buffer;
+        std::string scratch;
+        std::string escaped;
 
         for(;;) {
             if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
                 co_return;
             }
-            boost::system::error_code ec;
-            auto msg = co_await outgoing_messages_.async_receive(
-                boost::asio::bind_cancellation_slot(
-                    cancellation_state_.slot(),
-                    boost::asio::redirect_error(boost::asio::use_awaitable, ec))
-            );
-            if(ec) {
+            auto received = co_await outgoing_messages_->receive(cancellation_state_.slot());
+            if(!received) {
                 if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
                     co_return;
                 }
-                LERROR("{} write channel error with: {}", *this, ec.message());
+                LERROR("{} write queue error with: {}", *this, received.error().message());
                 co_await signalShutdown(TelnetDisconnect::error);
                 co_return;
             }
+            auto &msg = *received;
 
             if(std::holds_alternative<TelnetDisconnect>(msg)) {
                 co_await signalShutdown(TelnetDisconnect::server_disconnect);
@@ -402,27 +391,34 @@ namespace volcano::telnet {
             }
 
             auto &telnet_msg = std::get<TelnetMessage>(msg);
-            auto encoded = encodeTelnetMessage(telnet_msg);
-            if(encoded.empty()) {
+            auto payload = messagePayload(telnet_msg, scratch);
+            if(payload.empty()) {
                 continue;
             }
+            // game text is UTF-8; protocol messages (GMCP included) are sent as they are.
+            if(auto* wire = std::get_if<TelnetMessageWire>(&telnet_msg); wire && wire->wire && wire->charset == charset_) {
+                payload = *wire->wire;
+            } else if(std::holds_alternative<TelnetMessageData>(telnet_msg) || std::holds_alternative<TelnetMessageBuffer>(telnet_msg) || wire) {
+                payload = encode_app_data(charset_, payload, escaped);
+            }
+            record(RecordKind::outbound, payload);
 
-            buffer.consume(buffer.size());
-            compressed_buffer.consume(compressed_buffer.size());
-
-            auto dst = buffer.prepare(encoded.size());
-            std::memcpy(dst.data(), encoded.data(), encoded.size());
-            buffer.commit(encoded.size());
-
-            boost::beast::flat_buffer& use_buffer = compressing ? compressed_buffer : buffer;
-            if(compressing) {
+            boost::asio::const_buffer out(payload.data(), payload.size());
+            if(deflater) {
+                compressed_buffer.consume(compressed_buffer.size());
                 bool zlib_error = false;
                 try {
-                    auto input = buffer_as_bytes(buffer);
-                    deflater.write(input, [&](std::span<const std::byte> chunk) {
-                        append_bytes(compressed_buffer, chunk);
-                    }, volcano::zlib::FlushMode::sync);
-                    buffer.consume(buffer.size());
+                    auto input = std::as_bytes(std::span(payload.data(), payload.size()));
+                    const auto started = std::chrono::steady_clock::now();
+                    deflater->write_to(input, compressed_buffer, volcano::zlib::FlushMode::sync);
+                    const auto elapsed = std::chrono::steady_clock::now() - started;
+                    const int previous = tuner->level();
+                    if(auto level = tuner->record(input.size(), compressed_buffer.size(), elapsed)) {
+                        if(!deflater->set_params_to(*level, telnet_limits.mccp2.deflate.strategy, compressed_buffer)) {
+                            // zlib kept the old level; the next sample can try again.
+                            tuner->set_level(previous);
+                        }
+                    }
                 } catch (const std::exception& e) {
                     LERROR("{} zlib deflate error {}", *this, e.what());
                     zlib_error = true;
@@ -431,12 +427,13 @@ namespace volcano::telnet {
                     co_await signalShutdown(TelnetDisconnect::error);
                     co_return;
                 }
+                out = compressed_buffer.data();
             }
 
             boost::system::error_code write_ec;
             co_await boost::asio::async_write(
                 conn_,
-                use_buffer,
+                out,
                 boost::asio::bind_cancellation_slot(
                     cancellation_state_.slot(),
                     boost::asio::redirect_error(boost::asio::use_awaitable, write_ec)));
@@ -449,14 +446,27 @@ namespace volcano::telnet {
                 co_return;
             }
 
+            compressed_buffer.consume(compressed_buffer.size());
+            release_if_oversized(compressed_buffer);
+            for(auto* text : {&scratch, &escaped}) {
+                if(text->capacity() > telnet_limits.idle_buffer_capacity) {
+                    std::string().swap(*text);
+                }
+            }
+
             if(std::holds_alternative<TelnetMessageSubnegotiation>(telnet_msg)) {
                 auto& sub = std::get<TelnetMessageSubnegotiation>(telnet_msg);
                 if(sub.option == codes::MCCP2) {
-                    compressing = true;
                     nlohmann::json capabilities;
                     capabilities["mccp2_enabled"] = true;
                     co_await notifyChangedCapabilities(capabilities);
-                    deflater.reset(Z_BEST_COMPRESSION);
+                    tuner.emplace(telnet_limits.mccp2);
+                    // a restarted MCCP2 stream rewinds the existing deflater rather than reallocating it.
+                    if(deflater) {
+                        deflater->reset(telnet_limits.mccp2.deflate);
+                    } else {
+                        deflater.emplace(telnet_limits.mccp2.deflate);
+                    }
                 }
             }
         }
@@ -464,113 +474,107 @@ namespace volcano::telnet {
         co_return;
     }
 
+    boost::asio::awaitable<void> TelnetConnection::watchCongestion() {
+        // a client that stops reading leaves the writer's write pending forever, so one
+        // watcher per connection checks the queue instead of the writer timing each write.
+        if(outgoing_messages_->limits().policy != SlowClientPolicy::disconnect) {
+            co_return;
+        }
+        const auto limit = outgoing_messages_->limits().disconnect_after;
+        for(;;) {
+            if(outgoing_messages_->is_closed()) {
+                co_return;
+            }
+            const auto congested = outgoing_messages_->congested_for(boost::asio::steady_timer::clock_type::now());
+            if(congested >= limit) {
+                LERROR("{} output queue stayed over {} bytes; disconnecting slow client.", *this, outgoing_messages_->limits().high_water);
+                co_await signalShutdown(TelnetDisconnect::error);
+                co_return;
+            }
+            // not over high_water yet; look again a quarter of the way in.
+            congestion_timer_.expires_after(congested > boost::asio::steady_timer::duration::zero()
+                ? limit - congested
+                : std::max<boost::asio::steady_timer::duration>(limit / 4, std::chrono::milliseconds(100)));
+            boost::system::error_code timer_ec;
+            co_await congestion_timer_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, timer_ec));
+        }
+    }
+
     boost::asio::awaitable<void> TelnetConnection::signalShutdown(TelnetDisconnect reason) {
         shutdown_reason_.store(reason, std::memory_order_relaxed);
+        const char reason_byte = static_cast<char>(reason);
+        record(RecordKind::disconnect, {&reason_byte, 1});
         cancellation_signal_.emit(boost::asio::cancellation_type::all);
-        // close channels to ensure any async_receive wakes up promptly
-        outgoing_messages_.close();
-        if (to_telnet_messages_) {
-            to_telnet_messages_->close();
-        }
+        // close the writer queue so game-side producers stop queueing output.
+        outgoing_messages_->close();
         if(reason != TelnetDisconnect::server_disconnect) {
             // this was NOT initiated by us, so we should notify the other side.
-            boost::system::error_code ec;
-            co_await to_game_messages_->async_send(ec, reason, boost::asio::use_awaitable);
-            if(ec) {
-                LERROR("{} to_game_messages_ channel error: {}", *this, ec.message());
-            }
+            to_game_messages_->push(reason);
             to_game_messages_->close();
         }
         conn_.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both);
         conn_.lowest_layer().close();
         // timers seem to hate responding to cancellation signals so just cancel them directly.
-        keepalive_timer_.cancel();
+        negotiation_timer_.cancel();
+        congestion_timer_.cancel();
         co_return;
     }
 
     boost::asio::awaitable<void> TelnetConnection::negotiateOptions() {
-        using namespace boost::asio::experimental::awaitable_operators;
+        const auto started = boost::asio::steady_timer::clock_type::now();
 
-        auto exec = co_await boost::asio::this_coro::executor;
-        boost::asio::steady_timer deadline(exec);
-        deadline.expires_after(telnet_limits.negotiation_timeout);
-
-        auto wait_all = [&]() -> boost::asio::awaitable<void> {
-            for(auto& chan : pending_channels_) {
-                if(deadline.expiry() <= boost::asio::steady_timer::clock_type::now()) {
-                    co_return;
-                }
-                if(!chan) {
-                    continue;
-                }
-
-                boost::system::error_code recv_ec;
-                co_await chan->async_receive(boost::asio::redirect_error(boost::asio::use_awaitable, recv_ec));
+        auto wait_until = [&](boost::asio::steady_timer::time_point deadline) -> boost::asio::awaitable<bool> {
+            if(option_states_.pending == 0) {
+                co_return false;
             }
-
-            co_return;
+            negotiation_timer_.expires_at(deadline);
+            boost::system::error_code timer_ec;
+            co_await negotiation_timer_.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, timer_ec));
+            co_return option_states_.pending != 0 &&
+                cancellation_state_.cancelled() == boost::asio::cancellation_type::none;
         };
 
-        boost::system::error_code timer_ec;
-        auto result = co_await (
-            wait_all() ||
-            deadline.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, timer_ec))
-        );
-
-        if(result.index() == 1) {
+        // raw sockets and bots never send IAC; don't make them sit out the full timeout.
+        const auto probe = std::min(telnet_limits.negotiation_probe_timeout, telnet_limits.negotiation_timeout);
+        if(!co_await wait_until(started + probe) || !telnet_mode) {
             co_return;
         }
-
+        co_await wait_until(started + telnet_limits.negotiation_timeout);
         co_return;
     }
 
+    void TelnetConnection::completeNegotiation(std::uint16_t bits) {
+        option_states_.pending &= static_cast<std::uint16_t>(~bits);
+        if(option_states_.pending == 0) {
+            negotiation_timer_.cancel();
+        }
+    }
+
     boost::asio::awaitable<TelnetDisconnect> TelnetConnection::run() {
         using namespace boost::asio::experimental::awaitable_operators;
 
         shutdown_reason_.store(TelnetDisconnect::error, std::memory_order_relaxed);
+        enable_tcp_keepalive(conn_);
 
         // first start all options. this will send initial negotiation messages as needed.
-        for(auto& [code, option] : options_) {
-            co_await option->start();
+        for(const auto* option : telnet_options()) {
+            co_await option->start(*this);
         }
 
         auto r = runReader();
         auto w = runWriter();
-        auto k = runKeepAlive();
         auto l = runLink();
-        auto o = runOutboundBridge();
+        auto c = watchCongestion();
 
-        co_await (std::move(r) && std::move(w) && std::move(k) && std::move(l) && std::move(o));
+        co_await (std::move(r) && std::move(w) && std::move(l) && std::move(c));
 
         co_return shutdown_reason_.load(std::memory_order_relaxed);
     }
 
 
-    boost::asio::awaitable<void> TelnetConnection::sendToClient(const TelnetToTelnetMessage& msg) {
-        TelnetOutgoingMessage telnet_msg;
-        if(std::holds_alternative<TelnetDisconnect>(msg)) {
-            telnet_msg = std::get<TelnetDisconnect>(msg);
-        } else {
-            const auto &client_msg = std::get<TelnetClientMessage>(msg);
-            if(std::holds_alternative<TelnetMessageData>(client_msg)) {
-                TelnetMessageData data_msg = std::get<TelnetMessageData>(client_msg);
-                telnet_msg = TelnetMessage{data_msg};
-            } else if(std::holds_alternative<TelnetMessageGMCP>(client_msg)) {
-                TelnetMessageGMCP gmcp_msg = std::get<TelnetMessageGMCP>(client_msg);
-                telnet_msg = TelnetMessage{gmcp_msg.toSubnegotiation()};
-            } else if(std::holds_alternative<TelnetMessageMSSP>(client_msg)) {
-                TelnetMessageMSSP mssp_msg = std::get<TelnetMessageMSSP>(client_msg);
-                telnet_msg = TelnetMessage{mssp_msg.toSubnegotiation()};
-            } else {
-                LERROR("{} sendToClient received unknown message variant.", *this);
-                co_return;
-            }
-        }
-        
-        boost::system::error_code ec;
-        co_await outgoing_messages_.async_send(ec, std::move(telnet_msg), boost::asio::use_awaitable);
-        if(ec) {
-            LERROR("{} sendToClient channel error: {}", *this, ec.message());
+    boost::asio::awaitable<void> TelnetConnection::sendToClient(TelnetToTelnetMessage msg) {
+        if(outgoing_messages_->push(toOutgoingMessage(std::move(msg))) == PushResult::closed) {
+            LERROR("{} sendToClient after the write queue closed.", *this);
         }
         co_return;
     }
@@ -582,7 +586,7 @@ namespace volcano::telnet {
         link->hostname = conn_.hostname();
         link->client_data = client_data_;
         link->to_game = to_game_messages_;
-        link->to_telnet = to_telnet_messages_;
+        link->to_telnet = outgoing_messages_;
         return link;
     }
 
@@ -599,6 +603,13 @@ namespace volcano::telnet {
         client_data_.client_name = name;
         client_data_.client_version = version;
 
+        if(!negotiation_completed_) {
+            if(auto answered = find_client_profile(name, version)) {
+                // this client has never answered these, so stop waiting on them.
+                completeNegotiation(option_states_.pending & static_cast<std::uint16_t>(~*answered));
+            }
+        }
+
         int max_color = 1;
         std::string upper_name = boost::algorithm::to_upper_copy(name);
 
@@ -626,59 +637,57 @@ namespace volcano::telnet {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetConnection::handleAppData(TelnetMessageData& app_data) {
-        for (unsigned char ch : app_data.data) {
-            if (ch == 0x08 || ch == 0x7F) {
-                if (!append_data_buffer_.empty()) {
-                    append_data_buffer_.pop_back();
-                }
-                continue;
-            }
-            append_data_buffer_.push_back(static_cast<char>(ch));
-
-            if(append_data_buffer_.size() > telnet_limits.max_appdata_buffer) {
-                LERROR("{} appdata buffer exceeded limit ({} bytes).", *this, telnet_limits.max_appdata_buffer);
-                co_await sendAppData("Input line too long. Disconnecting.\r\n");
-                co_await sendToClient(TelnetDisconnect::error);
-                boost::system::error_code send_ec;
-                co_await to_game_messages_->async_send(send_ec, TelnetDisconnect::error, boost::asio::use_awaitable);
-                co_return;
-            }
+    boost::asio::awaitable<void> TelnetConnection::handleAppData(std::string_view app_data) {
+        if(!telnet_mode && !negotiation_completed_) {
+            // typed input before any telnet command: nothing is going to answer our offers.
+            completeNegotiation(option_states_.pending);
         }
 
-        auto send_line = [this](std::string line) -> boost::asio::awaitable<void> {
-            if (!line.empty() && line.back() == '\r') {
-                line.pop_back();
-            }
+        // single-byte charsets are widened to UTF-8 here; pure ASCII input needs no work.
+        if(charset_ != Charset::utf8 && ascii_prefix(app_data) != app_data.size()) {
+            decoded_input_.clear();
+            decode_to_utf8(charset_, app_data, decoded_input_);
+            app_data = decoded_input_;
+        }
 
-            boost::system::error_code ec;
-            co_await to_game_messages_->async_send(ec, TelnetMessageData{std::move(line)}, boost::asio::use_awaitable);
-            if(ec) {
-                LERROR("{} to_game channel error: {}", conn_, ec.message());
-            }
-        };
+        if(!line_assembler_.feed(app_data)) {
+            LERROR("{} appdata buffer exceeded limit ({} bytes).", *this, telnet_limits.max_appdata_buffer);
+            line_assembler_.clear();
+            co_await sendAppData("Input line too long. Disconnecting.\r\n");
+            co_await sendToClient(TelnetDisconnect::error);
+            to_game_messages_->push(TelnetDisconnect::error);
+            co_return;
+        }
 
-        for (;;) {
-            const auto pos = append_data_buffer_.find('\n');
-            if (pos == std::string::npos) {
-                break;
+        std::vector<std::string> lines;
+        while(auto line = line_assembler_.next_line()) {
+            std::string text(*line);
+            if(!telnet_limits.idle_commands.contains(text)) {
+                record(RecordKind::game_input, text);
+                lines.push_back(std::move(text));
             }
+        }
 
-            std::string line = append_data_buffer_.substr(0, pos);
-            if(!telnet_limits.idle_commands.contains(line)) {
-                co_await send_line(std::move(line));
-            }
-            append_data_buffer_.erase(0, pos + 1);
+        if(lines.empty()) {
+            co_return;
         }
 
+        // a paste becomes one message instead of one channel send per line.
+        TelnetGameMessage msg = lines.size() == 1
+            ? TelnetGameMessage{TelnetMessageData{std::move(lines.front())}}
+            : TelnetGameMessage{TelnetMessageLines{std::move(lines)}};
+
+        to_game_messages_->push(std::move(msg));
+
         co_return;
     }
 
     boost::asio::awaitable<void> TelnetConnection::handleNegotiate(TelnetMessageNegotiation& negotiation) {
         telnet_mode = true;
-        auto it = options_.find(negotiation.option);
-        if(it != options_.end()) {
-            co_await it->second->at_receive_negotiate(negotiation.command);
+        const char negotiation_bytes[2] = {negotiation.command, negotiation.option};
+        record(RecordKind::negotiation, {negotiation_bytes, 2});
+        if(const auto* option = telnet_option_table()[static_cast<unsigned char>(negotiation.option)]) {
+            co_await option->at_receive_negotiate(*this, negotiation.command);
         } else {
             // by default, refuse all negotiations
             char response_command;
@@ -705,9 +714,11 @@ namespace volcano::telnet {
 
     boost::asio::awaitable<void> TelnetConnection::handleSubNegotiation(TelnetMessageSubnegotiation& subnegotiation) {
         telnet_mode = true;
-        auto it = options_.find(subnegotiation.option);
-        if(it != options_.end()) {
-            co_await it->second->at_receive_subnegotiate(subnegotiation.data);
+        if(recorder_) {
+            record(RecordKind::subnegotiation, subnegotiation.option + subnegotiation.data);
+        }
+        if(const auto* option = telnet_option_table()[static_cast<unsigned char>(subnegotiation.option)]) {
+            co_await option->at_receive_subnegotiate(*this, subnegotiation.data);
         } else {
             // unhandled subnegotiation
         }
@@ -723,7 +734,7 @@ namespace volcano::telnet {
     boost::asio::awaitable<void> TelnetConnection::processData(TelnetMessage& data) {
         if(std::holds_alternative<TelnetMessageData>(data)) {
             TelnetMessageData& msg = std::get<TelnetMessageData>(data);
-            co_await handleAppData(msg);
+            co_await handleAppData(msg.data);
         } else if(std::holds_alternative<TelnetMessageNegotiation>(data)) {
             TelnetMessageNegotiation& msg = std::get<TelnetMessageNegotiation>(data);
             co_await handleNegotiate(msg);
@@ -741,69 +752,22 @@ namespace volcano::telnet {
     }
 
     boost::asio::awaitable<void> TelnetConnection::sendAppData(std::string_view app_data) {
-        boost::system::error_code ec;
-        co_await outgoing_messages_.async_send(ec, TelnetMessage{TelnetMessageData{std::string(app_data)}}, boost::asio::use_awaitable);
-        if(ec) {
-            LERROR("{} outgoing channel error: {}", *this, ec.message());
-        }
+        outgoing_messages_->push(TelnetMessage{TelnetMessageData{std::string(app_data)}});
         co_return;
     }
 
     boost::asio::awaitable<void> TelnetConnection::sendSubNegotiation(char option, std::string_view sub_data) {
-        boost::system::error_code ec;
-        co_await outgoing_messages_.async_send(ec, TelnetMessage{TelnetMessageSubnegotiation{option, std::string(sub_data)}}, boost::asio::use_awaitable);
-        if(ec) {
-            LERROR("{} outgoing channel error: {}", *this, ec.message());
-        }
+        outgoing_messages_->push(TelnetMessage{TelnetMessageSubnegotiation{option, std::string(sub_data)}});
         co_return;
     }
 
     boost::asio::awaitable<void> TelnetConnection::sendNegotiation(char command, char option) {
-        boost::system::error_code ec;
-        co_await outgoing_messages_.async_send(ec, TelnetMessage{TelnetMessageNegotiation{command, option}}, boost::asio::use_awaitable);
-        if(ec) {
-            LERROR("{} outgoing channel error: {}", *this, ec.message());
-        }
+        outgoing_messages_->push(TelnetMessage{TelnetMessageNegotiation{command, option}});
         co_return;
     }
 
     boost::asio::awaitable<void> TelnetConnection::sendCommand(char command) {
-        boost::system::error_code ec;
-        co_await outgoing_messages_.async_send(ec, TelnetMessage{TelnetMessageCommand{command}}, boost::asio::use_awaitable);
-        if(ec) {
-            LERROR("{} outgoing channel error: {}", *this, ec.message());
-        }
-        co_return;
-    }
-
-    boost::asio::awaitable<void> TelnetConnection::runKeepAlive() {
-        while(true) {
-            if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
-                co_return;
-            }
-            keepalive_timer_.expires_after(std::chrono::seconds(30));
-            boost::system::error_code timer_ec;
-            co_await keepalive_timer_.async_wait(
-                boost::asio::bind_cancellation_slot(
-                    cancellation_state_.slot(),
-                    boost::asio::redirect_error(boost::asio::use_awaitable, timer_ec)));
-            if(timer_ec) {
-                if(cancellation_state_.cancelled() != boost::asio::cancellation_type::none) {
-                    co_return;
-                }
-                if(timer_ec == boost::asio::error::operation_aborted) {
-                    co_return;
-                }
-                LERROR("{} keepalive timer error: {}", *this, timer_ec.message());
-                co_await signalShutdown(TelnetDisconnect::error);
-                co_return;
-            }
-
-            if(telnet_mode) {
-                co_await sendCommand(codes::NOP);
-            }
-        }
-
+        outgoing_messages_->push(TelnetMessage{TelnetMessageCommand{command}});
         co_return;
     }
 
@@ -811,11 +775,10 @@ namespace volcano::telnet {
         if(!negotiation_completed_) {
             co_return;
         }
-        boost::system::error_code ec;
-        co_await to_game_messages_->async_send(ec, TelnetChangeCapabilities{capabilities}, boost::asio::use_awaitable);
-        if(ec) {
-            LERROR("{} to_game channel error: {}", *this, ec.message());
+        if(recorder_) {
+            record(RecordKind::capabilities, capabilities.dump());
         }
+        to_game_messages_->push(TelnetChangeCapabilities{capabilities});
         co_return;
     }
 
@@ -0,0 +1,57 @@
+#include "volcano/telnet/LineAssembler.hpp"
+
+namespace volcano::telnet {
+
+    LineAssembler::LineAssembler(std::size_t limit) : limit_(limit) {
+    }
+
+    bool LineAssembler::feed(std::string_view data) {
+        if (read_ > 0) {
+            // only the partial line (and any lines the caller skipped) survive.
+            buffer_.erase(0, read_);
+            line_start_ -= read_;
+            read_ = 0;
+        }
+
+        while (!data.empty()) {
+            const auto erase_pos = data.find_first_of("\x08\x7f");
+            const auto run = data.substr(0, erase_pos);
+
+            buffer_.append(run);
+            if (const auto newline = run.rfind('\n'); newline != std::string_view::npos) {
+                line_start_ = buffer_.size() - run.size() + newline + 1;
+            }
+
+            if (erase_pos == std::string_view::npos) {
+                break;
+            }
+            if (buffer_.size() > line_start_) {
+                buffer_.pop_back();
+            }
+            data.remove_prefix(erase_pos + 1);
+        }
+
+        return pending() <= limit_;
+    }
+
+    std::optional<std::string_view> LineAssembler::next_line() {
+        if (read_ >= line_start_) {
+            return std::nullopt;
+        }
+
+        const auto end = buffer_.find('\n', read_);
+        std::string_view line(buffer_.data() + read_, end - read_);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        read_ = end + 1;
+        return line;
+    }
+
+    void LineAssembler::clear() {
+        buffer_.clear();
+        read_ = 0;
+        line_start_ = 0;
+    }
+
+}
@@ -1,57 +1,62 @@
 #include "volcano/telnet/Option.hpp"
 #include "volcano/telnet/Connection.hpp"
 #include "volcano/log/Log.hpp"
+#include "Codec.hpp"
 
 #include <boost/algorithm/string.hpp>
 
 #include <algorithm>
 #include <cctype>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 namespace volcano::telnet {
 
-    TelnetOption::TelnetOption(TelnetConnection& connection) : tc(connection) {
+    TelnetOption::TelnetOption(std::uint8_t slot) : slot_(slot) {
     }
 
-    boost::asio::awaitable<void> TelnetOption::start() {
-        getPendingChannel(getBaseChannelName());
-
+    boost::asio::awaitable<void> TelnetOption::start(TelnetConnection& tc) const {
         auto local_info = getLocalSupportInfo();
         auto remote_info = getRemoteSupportInfo();
 
+        // only options we actually ask about hold up negotiation.
         if(local_info.first && local_info.second) {
-            co_await send_negotiation(codes::WILL);
-            local.negotiating = true;
+            states(tc).pending |= pending_bit();
+            co_await send_negotiation(tc, codes::WILL);
+            local(tc).negotiating = true;
         }
 
         if(remote_info.first && remote_info.second) {
-            co_await send_negotiation(codes::DO);
-            remote.negotiating = true;
+            states(tc).pending |= pending_bit();
+            co_await send_negotiation(tc, codes::DO);
+            remote(tc).negotiating = true;
         }
 
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::send_negotiation(char command) {
+    boost::asio::awaitable<void> TelnetOption::send_negotiation(TelnetConnection& tc, char command) const {
         co_await tc.sendNegotiation(command, option_code());
-        co_await at_send_negotiate(command);
+        co_await at_send_negotiate(tc, command);
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::send_subnegotiate(std::string_view data) {
+    boost::asio::awaitable<void> TelnetOption::send_subnegotiate(TelnetConnection& tc, std::string_view data) const {
         co_await tc.sendSubNegotiation(option_code(), data);
-        co_await at_send_subnegotiate(data);
+        co_await at_send_subnegotiate(tc, data);
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_send_negotiate(char command) {
+    boost::asio::awaitable<void> TelnetOption::at_send_negotiate(TelnetConnection& tc, char command) const {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_send_subnegotiate(std::string_view data) {
+    boost::asio::awaitable<void> TelnetOption::at_send_subnegotiate(TelnetConnection& tc, std::string_view data) const {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_receive_negotiate(char command) {
+    boost::asio::awaitable<void> TelnetOption::at_receive_negotiate(TelnetConnection& tc, char command) const {
         auto local_info = getLocalSupportInfo();
         auto remote_info = getRemoteSupportInfo();
 
@@ -59,57 +64,57 @@ namespace volcano::telnet {
             case codes::WILL: {
                 if(remote_info.first) {
                     // supported...
-                    if(!remote.enabled) {
-                        remote.enabled = true;
-                        if(!remote.negotiating) {
-                            co_await send_negotiation(codes::DO);
+                    if(!remote(tc).enabled) {
+                        remote(tc).enabled = true;
+                        if(!remote(tc).negotiating) {
+                            co_await send_negotiation(tc, codes::DO);
                         }
-                        co_await at_remote_enable();
+                        co_await at_remote_enable(tc);
                     }
                 } else {
-                    co_await send_negotiation(codes::DONT);
-                    co_await at_remote_reject();
+                    co_await send_negotiation(tc, codes::DONT);
+                    co_await at_remote_reject(tc);
                 }
             }
             break;
             case codes::DO: {
                 if(local_info.first) {
                     // supported...
-                    if(!local.enabled) {
-                        local.enabled = true;
-                        if(!local.negotiating) {
-                            co_await send_negotiation(codes::WILL);
+                    if(!local(tc).enabled) {
+                        local(tc).enabled = true;
+                        if(!local(tc).negotiating) {
+                            co_await send_negotiation(tc, codes::WILL);
                         }
-                        co_await at_local_enable();
+                        co_await at_local_enable(tc);
                     }
                 } else {
-                    co_await send_negotiation(codes::WONT);
-                    co_await at_local_reject();
+                    co_await send_negotiation(tc, codes::WONT);
+                    co_await at_local_reject(tc);
                 }
             }
             break;
             case codes::WONT: {
                 if(remote_info.first) {
-                    if(remote.enabled) {
-                        remote.enabled = false;
-                        co_await at_remote_disable();
+                    if(remote(tc).enabled) {
+                        remote(tc).enabled = false;
+                        co_await at_remote_disable(tc);
                     }
-                    if(remote.negotiating) {
-                        remote.negotiating = false;
-                        co_await at_remote_reject();
+                    if(remote(tc).negotiating) {
+                        remote(tc).negotiating = false;
+                        co_await at_remote_reject(tc);
                     }
                 }
             }
             break;
             case codes::DONT: {
                 if(local_info.first) {
-                    if(local.enabled) {
-                        local.enabled = false;
-                        co_await at_local_disable();
+                    if(local(tc).enabled) {
+                        local(tc).enabled = false;
+                        co_await at_local_disable(tc);
                     }
-                    if(local.negotiating) {
-                        local.negotiating = false;
-                        co_await at_local_reject();
+                    if(local(tc).negotiating) {
+                        local(tc).negotiating = false;
+                        co_await at_local_reject(tc);
                     }
                 }
             }
@@ -121,73 +126,78 @@ namespace volcano::telnet {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_receive_subnegotiate(std::string_view data) {
+    boost::asio::awaitable<void> TelnetOption::at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_local_reject() {
-        co_await markNegotiationComplete(getBaseChannelName());
+    boost::asio::awaitable<void> TelnetOption::at_local_reject(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_remote_reject() {
-        co_await markNegotiationComplete(getBaseChannelName());
+    boost::asio::awaitable<void> TelnetOption::at_remote_reject(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_local_enable() {
-        co_await markNegotiationComplete(getBaseChannelName());
+    boost::asio::awaitable<void> TelnetOption::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_remote_enable() {
-        co_await markNegotiationComplete(getBaseChannelName());
+    boost::asio::awaitable<void> TelnetOption::at_remote_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_local_disable() {
+    boost::asio::awaitable<void> TelnetOption::at_local_disable(TelnetConnection& tc) const {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::at_remote_disable() {
+    boost::asio::awaitable<void> TelnetOption::at_remote_disable(TelnetConnection& tc) const {
         co_return;
     }
 
-    boost::asio::awaitable<void> TelnetOption::markNegotiationComplete(std::string name) {
+    TelnetOptionStates& TelnetOption::states(TelnetConnection& tc) const {
+        return tc.option_states_;
+    }
+
+    TelnetOptionState& TelnetOption::local(TelnetConnection& tc) const {
+        return tc.option_states_.local[slot_];
+    }
+
+    TelnetOptionState& TelnetOption::remote(TelnetConnection& tc) const {
+        return tc.option_states_.remote[slot_];
+    }
+
+    void TelnetOption::markNegotiationComplete(TelnetConnection& tc) const {
         if(tc.is_negotiation_completed()) {
-            co_return; // already completed no need to signal
+            return; // already completed no need to signal
         }
-        auto channel = getPendingChannel(name);
-        boost::system::error_code ec;
-        co_await channel->async_send(ec, true, boost::asio::use_awaitable);
-        co_return;
+        states(tc).answered |= pending_bit();
+        tc.completeNegotiation(pending_bit());
     }
 
-    volcano::mud::ClientData& TelnetOption::client_data() {
+    volcano::mud::ClientData& TelnetOption::client_data(TelnetConnection& tc) const {
         return tc.client_data_;
     }
 
-    boost::asio::awaitable<void> TelnetOption::notifyChangedCapabilities(nlohmann::json& capabilities) {
-        co_await tc.notifyChangedCapabilities(capabilities);
-        co_return;
+    void TelnetOption::set_encoding(TelnetConnection& tc, std::string encoding) const {
+        tc.charset_ = charset_from_name(encoding);
+        tc.outgoing_messages_->set_charset(tc.charset_);
+        tc.client_data_.encoding = std::move(encoding);
     }
 
-    std::shared_ptr<Channel<bool>> TelnetOption::getPendingChannel(const std::string& name) {
-        auto it = pending_channels_.find(name);
-        if (it != pending_channels_.end()) {
-            return it->second;
-        }
-        auto channel = std::make_shared<Channel<bool>>(tc.conn_.get_executor(), 1);
-        pending_channels_[name] = channel;
-        tc.pending_channels_.push_back(channel);
-        return channel;
+    boost::asio::awaitable<void> TelnetOption::notifyChangedCapabilities(TelnetConnection& tc, nlohmann::json& capabilities) const {
+        co_await tc.notifyChangedCapabilities(capabilities);
+        co_return;
     }
 
-    std::pair<bool, bool> TelnetOption::getLocalSupportInfo() {
+    std::pair<bool, bool> TelnetOption::getLocalSupportInfo() const {
         return {false, false};
     }
 
-    std::pair<bool, bool> TelnetOption::getRemoteSupportInfo() {
+    std::pair<bool, bool> TelnetOption::getRemoteSupportInfo() const {
         return {false, false};
     }
 
@@ -196,26 +206,26 @@ namespace volcano::telnet {
         return codes::NAWS;
     }
 
-    std::pair<bool, bool> NAWSOption::getRemoteSupportInfo() {
+    std::pair<bool, bool> NAWSOption::getRemoteSupportInfo() const {
         // we always support NAWS, but do not auto-start it.
         return {true, true};
     }
 
-    boost::asio::awaitable<void> NAWSOption::at_remote_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().naws = true;
+    boost::asio::awaitable<void> NAWSOption::at_remote_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).naws = true;
         nlohmann::json capabilities;
         capabilities["naws"] = true;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
         co_return;
     }
 
-    boost::asio::awaitable<void> NAWSOption::at_receive_subnegotiate(std::string_view data) {
+    boost::asio::awaitable<void> NAWSOption::at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const {
         if(data.size() != 4) {
             co_return;
         }
 
-        auto &cd = client_data();
+        auto &cd = client_data(tc);
         auto old_width = cd.width;
         auto old_height = cd.height;
 
@@ -232,34 +242,26 @@ namespace volcano::telnet {
         nlohmann::json capabilities;
         capabilities["width"] = width;
         capabilities["height"] = height;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
 
         co_return;
     }
 
-    std::string NAWSOption::getBaseChannelName() {
-        return "NAWS";
-    }
-
     // SGA Section
     char SGAOption::option_code() const {
         return codes::SGA;
     }
 
-    std::string SGAOption::getBaseChannelName() {
-        return "SGA";
-    }
-
-    std::pair<bool, bool> SGAOption::getLocalSupportInfo() {
+    std::pair<bool, bool> SGAOption::getLocalSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> SGAOption::at_local_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().sga = true;
+    boost::asio::awaitable<void> SGAOption::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).sga = true;
         nlohmann::json capabilities;
         capabilities["sga"] = true;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
         co_return;
     }
 
@@ -268,53 +270,53 @@ namespace volcano::telnet {
         return codes::CHARSET;
     }
 
-    std::string CHARSETOption::getBaseChannelName() {
-        return "CHARSET";
-    }
-
-    std::pair<bool, bool> CHARSETOption::getRemoteSupportInfo() {
+    std::pair<bool, bool> CHARSETOption::getRemoteSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> CHARSETOption::request_charset() {
+    boost::asio::awaitable<void> CHARSETOption::request_charset(TelnetConnection& tc) const {
         std::string data;
         data.push_back(static_cast<char>(0x01));
-        data += " ascii utf-8";
-        co_await send_subnegotiate(data);
+        // clients accept the first name they support, so utf-8 goes ahead of the transcoded charsets.
+        data += " utf-8 iso-8859-1 cp437 ascii";
+        co_await send_subnegotiate(tc, data);
         co_return;
     }
 
-    boost::asio::awaitable<void> CHARSETOption::at_remote_enable() {
-        client_data().charset = true;
-        if (!enabled_) {
-            enabled_ = "remote";
-            co_await request_charset();
+    boost::asio::awaitable<void> CHARSETOption::at_remote_enable(TelnetConnection& tc) const {
+        client_data(tc).charset = true;
+        if (!states(tc).charset_requested) {
+            states(tc).charset_requested = true;
+            co_await request_charset(tc);
         }
         co_return;
     }
 
-    boost::asio::awaitable<void> CHARSETOption::at_local_enable() {
-        client_data().charset = true;
-        if (!enabled_) {
-            enabled_ = "local";
-            co_await request_charset();
+    boost::asio::awaitable<void> CHARSETOption::at_local_enable(TelnetConnection& tc) const {
+        client_data(tc).charset = true;
+        if (!states(tc).charset_requested) {
+            states(tc).charset_requested = true;
+            co_await request_charset(tc);
         }
         co_return;
     }
 
-    boost::asio::awaitable<void> CHARSETOption::at_receive_subnegotiate(std::string_view data) {
-        if (data.size() < 2) {
+    boost::asio::awaitable<void> CHARSETOption::at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const {
+        if (data.empty()) {
             co_return;
         }
 
-        if (static_cast<unsigned char>(data[0]) == 0x02) {
+        if (static_cast<unsigned char>(data[0]) == 0x02 && data.size() >= 2) {
             std::string encoding(data.substr(1));
-            client_data().encoding = encoding;
+            set_encoding(tc, encoding);
             nlohmann::json capabilities;
             capabilities["encoding"] = encoding;
             capabilities["charset"] = true;
-            co_await notifyChangedCapabilities(capabilities);
-            co_await markNegotiationComplete(getBaseChannelName());
+            co_await notifyChangedCapabilities(tc, capabilities);
+            markNegotiationComplete(tc);
+        } else if (static_cast<unsigned char>(data[0]) == 0x03) {
+            // REJECTED: the client has nothing we offered, but it did answer.
+            markNegotiationComplete(tc);
         }
         co_return;
     }
@@ -324,30 +326,26 @@ namespace volcano::telnet {
         return codes::MTTS;
     }
 
-    std::string MTTSOption::getBaseChannelName() {
-        return "MTTS";
-    }
-
-    std::pair<bool, bool> MTTSOption::getRemoteSupportInfo() {
+    std::pair<bool, bool> MTTSOption::getRemoteSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> MTTSOption::at_remote_enable() {
-        client_data().mtts = true;
+    boost::asio::awaitable<void> MTTSOption::at_remote_enable(TelnetConnection& tc) const {
+        client_data(tc).mtts = true;
         nlohmann::json capabilities;
         capabilities["mtts"] = true;
-        co_await notifyChangedCapabilities(capabilities);
-        if (number_requests_ == 0) {
-            co_await request();
+        co_await notifyChangedCapabilities(tc, capabilities);
+        if (states(tc).mtts_requests == 0) {
+            co_await request(tc);
         }
         co_return;
     }
 
-    boost::asio::awaitable<void> MTTSOption::request() {
-        number_requests_ += 1;
+    boost::asio::awaitable<void> MTTSOption::request(TelnetConnection& tc) const {
+        states(tc).mtts_requests += 1;
         std::string data;
         data.push_back(static_cast<char>(0x01));
-        co_await send_subnegotiate(data);
+        co_await send_subnegotiate(tc, data);
         co_return;
     }
 
@@ -359,7 +357,7 @@ namespace volcano::telnet {
         return out;
     }
 
-    boost::asio::awaitable<void> MTTSOption::handle_name(std::string_view data) {
+    boost::asio::awaitable<void> MTTSOption::handle_name(TelnetConnection& tc, std::string_view data) const {
         nlohmann::json out;
 
         std::string payload(data);
@@ -379,13 +377,13 @@ namespace volcano::telnet {
         co_return;
     }
 
-    boost::asio::awaitable<void> MTTSOption::handle_ttype(std::string_view data) {
+    boost::asio::awaitable<void> MTTSOption::handle_ttype(TelnetConnection& tc, std::string_view data) const {
         std::string payload(data);
         auto dash_pos = payload.find('-');
 
         std::string first = (dash_pos == std::string::npos) ? payload : payload.substr(0, dash_pos);
 
-        int max_color = client_data().color;
+        int max_color = client_data(tc).color;
 
         std::string upper_first = to_upper_copy(first);
         if (max_color < 2) {
@@ -398,25 +396,25 @@ namespace volcano::telnet {
         nlohmann::json out;
 
         if (upper_first == "VT100") {
-            client_data().vt100 = true;
+            client_data(tc).vt100 = true;
             out["vt100"] = true;
         } else if (upper_first == "XTERM") {
             max_color = std::max(max_color, 2);
         }
 
-        if (max_color != client_data().color) {
-            client_data().color = static_cast<uint8_t>(max_color);
+        if (max_color != client_data(tc).color) {
+            client_data(tc).color = static_cast<uint8_t>(max_color);
             out["color"] = max_color;
         }
 
         if (!out.empty()) {
-            co_await notifyChangedCapabilities(out);
+            co_await notifyChangedCapabilities(tc, out);
         }
 
         co_return;
     }
 
-    boost::asio::awaitable<void> MTTSOption::handle_standard(std::string_view data) {
+    boost::asio::awaitable<void> MTTSOption::handle_standard(TelnetConnection& tc, std::string_view data) const {
         if (!data.starts_with("MTTS ")) {
             co_return;
         }
@@ -437,7 +435,7 @@ namespace volcano::telnet {
         };
 
         nlohmann::json out;
-        int max_color = client_data().color;
+        int max_color = client_data(tc).color;
 
         for (const auto& entry : mtts_values) {
             if ((number & entry.bit) == 0) {
@@ -452,42 +450,42 @@ namespace volcano::telnet {
             } else if (capability == "ansi") {
                 max_color = std::max(max_color, 1);
             } else if (capability == "utf8") {
-                client_data().encoding = "utf-8";
+                set_encoding(tc, "utf-8");
                 out["encoding"] = "utf-8";
             } else if (capability == "screenreader") {
-                client_data().screen_reader = true;
+                client_data(tc).screen_reader = true;
                 out["screenreader"] = true;
             } else if (capability == "mouse_tracking") {
-                client_data().mouse_tracking = true;
+                client_data(tc).mouse_tracking = true;
                 out["mouse_tracking"] = true;
             } else if (capability == "osc_color_palette") {
-                client_data().osc_color_palette = true;
+                client_data(tc).osc_color_palette = true;
                 out["osc_color_palette"] = true;
             } else if (capability == "proxy") {
-                client_data().proxy = true;
+                client_data(tc).proxy = true;
                 out["proxy"] = true;
             } else if (capability == "vt100") {
-                client_data().vt100 = true;
+                client_data(tc).vt100 = true;
                 out["vt100"] = true;
             } else if (capability == "mnes") {
-                client_data().mnes = true;
+                client_data(tc).mnes = true;
                 out["mnes"] = true;
             }
         }
 
-        if (max_color != client_data().color) {
-            client_data().color = static_cast<uint8_t>(max_color);
+        if (max_color != client_data(tc).color) {
+            client_data(tc).color = static_cast<uint8_t>(max_color);
             out["color"] = max_color;
         }
 
         if (!out.empty()) {
-            co_await notifyChangedCapabilities(out);
+            co_await notifyChangedCapabilities(tc, out);
         }
 
         co_return;
     }
 
-    boost::asio::awaitable<void> MTTSOption::at_receive_subnegotiate(std::string_view data) {
+    boost::asio::awaitable<void> MTTSOption::at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const {
         if (data.empty()) {
             co_return;
         }
@@ -496,21 +494,23 @@ namespace volcano::telnet {
         }
 
         std::string payload(data.substr(1));
-        if (payload == last_received_) {
-            co_await markNegotiationComplete(getBaseChannelName());
+        // clients cycle back to their first answer once they run out of types.
+        const auto hash = std::hash<std::string>{}(payload);
+        if (hash == states(tc).mtts_last_hash) {
+            markNegotiationComplete(tc);
             co_return;
         }
-        last_received_ = payload;
+        states(tc).mtts_last_hash = hash;
 
-        if (number_requests_ == 1) {
-            co_await handle_name(payload);
-            co_await request();
-        } else if (number_requests_ == 2) {
-            co_await handle_ttype(payload);
-            co_await request();
-        } else if (number_requests_ == 3) {
-            co_await handle_standard(payload);
-            co_await markNegotiationComplete(getBaseChannelName());
+        if (states(tc).mtts_requests == 1) {
+            co_await handle_name(tc, payload);
+            co_await request(tc);
+        } else if (states(tc).mtts_requests == 2) {
+            co_await handle_ttype(tc, payload);
+            co_await request(tc);
+        } else if (states(tc).mtts_requests == 3) {
+            co_await handle_standard(tc, payload);
+            markNegotiationComplete(tc);
         }
 
         co_return;
@@ -521,20 +521,16 @@ namespace volcano::telnet {
         return codes::MSSP;
     }
 
-    std::string MSSPOption::getBaseChannelName() {
-        return "MSSP";
-    }
-
-    std::pair<bool, bool> MSSPOption::getLocalSupportInfo() {
+    std::pair<bool, bool> MSSPOption::getLocalSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> MSSPOption::at_local_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().mssp = true;
+    boost::asio::awaitable<void> MSSPOption::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).mssp = true;
         nlohmann::json capabilities;
         capabilities["mssp"] = true;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
         co_return;
     }
 
@@ -543,27 +539,23 @@ namespace volcano::telnet {
         return codes::MCCP2;
     }
 
-    std::string MCCP2Option::getBaseChannelName() {
-        return "MCCP2";
-    }
-
-    std::pair<bool, bool> MCCP2Option::getLocalSupportInfo() {
+    std::pair<bool, bool> MCCP2Option::getLocalSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> MCCP2Option::at_local_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().mccp2 = true;
+    boost::asio::awaitable<void> MCCP2Option::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).mccp2 = true;
         nlohmann::json capabilities;
         capabilities["mccp2"] = true;
-        co_await notifyChangedCapabilities(capabilities);
-        co_await send_subnegotiate("");
+        co_await notifyChangedCapabilities(tc, capabilities);
+        co_await send_subnegotiate(tc, "");
         co_return;
     }
 
-    boost::asio::awaitable<void> MCCP2Option::at_send_subnegotiate(std::string_view data) {
-        if (!client_data().mccp2_enabled) {
-            client_data().mccp2_enabled = true;
+    boost::asio::awaitable<void> MCCP2Option::at_send_subnegotiate(TelnetConnection& tc, std::string_view data) const {
+        if (!client_data(tc).mccp2_enabled) {
+            client_data(tc).mccp2_enabled = true;
         }
         co_return;
     }
@@ -573,29 +565,25 @@ namespace volcano::telnet {
         return codes::MCCP3;
     }
 
-    std::string MCCP3Option::getBaseChannelName() {
-        return "MCCP3";
-    }
-
-    std::pair<bool, bool> MCCP3Option::getLocalSupportInfo() {
+    std::pair<bool, bool> MCCP3Option::getLocalSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> MCCP3Option::at_local_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().mccp3 = true;
+    boost::asio::awaitable<void> MCCP3Option::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).mccp3 = true;
         nlohmann::json capabilities;
         capabilities["mccp3"] = true;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
         co_return;
     }
 
-    boost::asio::awaitable<void> MCCP3Option::at_receive_subnegotiate(std::string_view data) {
-        if (!client_data().mccp3_enabled) {
-            client_data().mccp3_enabled = true;
+    boost::asio::awaitable<void> MCCP3Option::at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const {
+        if (!client_data(tc).mccp3_enabled) {
+            client_data(tc).mccp3_enabled = true;
             nlohmann::json capabilities;
             capabilities["mccp3_enabled"] = true;
-            co_await notifyChangedCapabilities(capabilities);
+            co_await notifyChangedCapabilities(tc, capabilities);
         }
         co_return;
     }
@@ -605,48 +593,33 @@ namespace volcano::telnet {
         return codes::GMCP;
     }
 
-    std::string GMCPOption::getBaseChannelName() {
-        return "GMCP";
-    }
-
-    std::pair<bool, bool> GMCPOption::getLocalSupportInfo() {
+    std::pair<bool, bool> GMCPOption::getLocalSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> GMCPOption::at_local_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().gmcp = true;
+    boost::asio::awaitable<void> GMCPOption::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).gmcp = true;
         nlohmann::json capabilities;
         capabilities["gmcp"] = true;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
         co_return;
     }
 
-    boost::asio::awaitable<void> GMCPOption::at_receive_subnegotiate(std::string_view data) {
-        std::string payload(data);
-        std::string command;
-        std::string json_payload;
+    boost::asio::awaitable<void> GMCPOption::at_receive_subnegotiate(TelnetConnection& tc, std::string_view data) const {
+        auto [command, json_payload] = splitGMCP(data);
 
-        auto space_pos = payload.find(' ');
-        if (space_pos != std::string::npos) {
-            command = payload.substr(0, space_pos);
-            json_payload = payload.substr(space_pos + 1);
-        } else {
-            command = payload;
-        }
-
-        nlohmann::json parsed;
-        if (!json_payload.empty()) {
-            try {
-                parsed = nlohmann::json::parse(json_payload);
-            } catch (...) {
-                parsed = nullptr;
+        // only the packages we act on are parsed here; the rest go to the game as text.
+        auto parse = [&]() {
+            if (json_payload.empty()) {
+                return nlohmann::json(nullptr);
             }
-        } else {
-            parsed = nullptr;
-        }
+            auto parsed = nlohmann::json::parse(json_payload, nullptr, false);
+            return parsed.is_discarded() ? nlohmann::json(nullptr) : parsed;
+        };
 
         if(boost::iequals(command, "Core.Hello")) {
+            auto parsed = parse();
             if(parsed.is_object()) {
                 if(parsed.contains("client") && parsed["client"].is_string()) {
                     std::string client_name = parsed["client"];
@@ -658,34 +631,28 @@ namespace volcano::telnet {
                 }
             }
         } else if (boost::iequals(command, "Core.Supports.Set")) {
+            auto parsed = parse();
             if(parsed.is_array()) {
-                auto& gmcp_supports_set = client_data().gmcp_supports_set;
+                auto& gmcp_supports_set = client_data(tc).gmcp_supports_set;
                 gmcp_supports_set.clear();
                 parsed.get_to(gmcp_supports_set);
                 nlohmann::json capabilities;
                 capabilities["gmcp_supports_set"] = gmcp_supports_set;
-                co_await notifyChangedCapabilities(capabilities);
+                co_await notifyChangedCapabilities(tc, capabilities);
             }
         } else {
-            boost::system::error_code ec;
-            co_await tc.to_game_channel().async_send(
-                ec,
-                TelnetMessageGMCP{std::move(command), std::move(parsed)},
-                boost::asio::use_awaitable);
-            if (ec) {
-                LERROR("{} gmcp to_game channel error: {}", tc, ec.message());
-            }
+            tc.to_game_queue().push(TelnetReceivedGMCP{std::string(command), std::string(json_payload)});
         }
         co_return;
     }
 
-    boost::asio::awaitable<void> GMCPOption::send_gmcp(std::string_view command, const nlohmann::json* data) {
+    boost::asio::awaitable<void> GMCPOption::send_gmcp(TelnetConnection& tc, std::string_view command, const nlohmann::json* data) const {
         std::string out(command);
         if (data) {
             out.push_back(' ');
             out += data->dump();
         }
-        co_await send_subnegotiate(out);
+        co_await send_subnegotiate(tc, out);
         co_return;
     }
 
@@ -694,20 +661,16 @@ namespace volcano::telnet {
         return codes::LINEMODE;
     }
 
-    std::string LineModeOption::getBaseChannelName() {
-        return "LINEMODE";
-    }
-
-    std::pair<bool, bool> LineModeOption::getLocalSupportInfo() {
+    std::pair<bool, bool> LineModeOption::getLocalSupportInfo() const {
         return {true, true};
     }
 
-    boost::asio::awaitable<void> LineModeOption::at_local_enable() {
-        co_await TelnetOption::markNegotiationComplete(getBaseChannelName());
-        client_data().linemode = true;
+    boost::asio::awaitable<void> LineModeOption::at_local_enable(TelnetConnection& tc) const {
+        markNegotiationComplete(tc);
+        client_data(tc).linemode = true;
         nlohmann::json capabilities;
         capabilities["linemode"] = true;
-        co_await notifyChangedCapabilities(capabilities);
+        co_await notifyChangedCapabilities(tc, capabilities);
         co_return;
     }
 
@@ -716,9 +679,97 @@ namespace volcano::telnet {
         return codes::TELOPT_EOR;
     }
 
-    std::string EOROption::getBaseChannelName() {
-        return "EOR";
+    std::span<const TelnetOption* const> telnet_options() {
+        static const SGAOption sga{0};
+        static const NAWSOption naws{1};
+        static const CHARSETOption charset{2};
+        static const MTTSOption mtts{3};
+        static const MSSPOption mssp{4};
+        static const MCCP2Option mccp2{5};
+        static const MCCP3Option mccp3{6};
+        static const GMCPOption gmcp{7};
+        static const LineModeOption linemode{8};
+        static const EOROption eor{9};
+        static const std::array<const TelnetOption*, 10> options{
+            &sga, &naws, &charset, &mtts, &mssp, &mccp2, &mccp3, &gmcp, &linemode, &eor
+        };
+        static_assert(options.size() <= TelnetOptionStates::max_options);
+        return options;
+    }
+
+    const std::array<const TelnetOption*, 256>& telnet_option_table() {
+        static const auto table = [] {
+            std::array<const TelnetOption*, 256> out{};
+            for (const auto* option : telnet_options()) {
+                out[static_cast<unsigned char>(option->option_code())] = option;
+            }
+            return out;
+        }();
+        return table;
+    }
+
+    namespace {
+        std::mutex client_profiles_mutex;
+        std::unordered_map<std::string, std::uint16_t> client_profiles;
+
+        // real client names and versions are short; anything longer is not worth remembering.
+        constexpr std::size_t max_client_profile_field = 64;
+
+        // names are client-chosen, so the key is trimmed and upper-cased, and names that are
+        // overlong or carry control bytes get no key at all rather than a cache slot.
+        std::optional<std::string> client_profile_key(std::string_view name, std::string_view version) {
+            auto normalise = [](std::string_view field) -> std::optional<std::string_view> {
+                while (!field.empty() && std::isspace(static_cast<unsigned char>(field.front()))) {
+                    field.remove_prefix(1);
+                }
+                while (!field.empty() && std::isspace(static_cast<unsigned char>(field.back()))) {
+                    field.remove_suffix(1);
+                }
+                if (field.size() > max_client_profile_field ||
+                    std::ranges::any_of(field, [](unsigned char ch) { return ch < 0x20 || ch == 0x7f; })) {
+                    return std::nullopt;
+                }
+                return field;
+            };
+            auto clean_name = normalise(name);
+            auto clean_version = normalise(version);
+            if (!clean_name || clean_name->empty() || !clean_version) {
+                return std::nullopt;
+            }
+            std::string key = to_upper_copy(*clean_name);
+            key.push_back('/');
+            key += *clean_version;
+            return key;
+        }
+    }
+
+    std::optional<std::uint16_t> find_client_profile(std::string_view name, std::string_view version) {
+        const auto key = client_profile_key(name, version);
+        if (!key) {
+            return std::nullopt;
+        }
+        std::lock_guard lock(client_profiles_mutex);
+        if (auto it = client_profiles.find(*key); it != client_profiles.end()) {
+            return it->second;
+        }
+        return std::nullopt;
     }
 
+    void remember_client_profile(std::string_view name, std::string_view version, std::uint16_t answered) {
+        auto key = client_profile_key(name, version);
+        if (!key) {
+            return;
+        }
+        std::lock_guard lock(client_profiles_mutex);
+        if (auto it = client_profiles.find(*key); it != client_profiles.end()) {
+            // merged, so an option answered late once is still waited on next time.
+            it->second |= answered;
+            return;
+        }
+        if (client_profiles.size() >= telnet_limits.client_profile_cache_size) {
+            return;
+        }
+        client_profiles.emplace(std::move(*key), answered);
+    }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,261 @@
+#include "volcano/telnet/OutgoingQueue.hpp"
+
+#include <atomic>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace volcano::telnet {
+
+    namespace {
+        std::atomic<std::size_t> total_queued_bytes{0};
+        std::atomic<std::size_t> total_queued_messages{0};
+        std::atomic<std::uint64_t> total_dropped{0};
+        std::atomic<std::uint64_t> total_collapsed{0};
+
+        // nlohmann payloads are only serialized by the writer, so they are costed at a flat estimate.
+        constexpr std::size_t unserialized_gmcp_estimate = 64;
+
+        std::size_t message_bytes(const TelnetOutgoingMessage& msg) {
+            if (!std::holds_alternative<TelnetMessage>(msg)) {
+                return 0;
+            }
+            return std::visit([](const auto& m) -> std::size_t {
+                using T = std::decay_t<decltype(m)>;
+                if constexpr (std::is_same_v<T, TelnetMessageData>) {
+                    return m.data.size();
+                } else if constexpr (std::is_same_v<T, TelnetMessageBuffer>) {
+                    return m.data ? m.data->size() : 0;
+                } else if constexpr (std::is_same_v<T, TelnetMessageWire>) {
+                    return m.wire ? m.wire->size() : (m.text ? m.text->size() : 0);
+                } else if constexpr (std::is_same_v<T, TelnetMessagePreparedGMCP>) {
+                    return m.gmcp ? m.gmcp->frame.size() : 0;
+                } else if constexpr (std::is_same_v<T, TelnetMessageGMCP>) {
+                    return m.package.size() + unserialized_gmcp_estimate;
+                } else if constexpr (std::is_same_v<T, TelnetMessageSubnegotiation>) {
+                    return m.data.size() + 5;
+                } else if constexpr (std::is_same_v<T, TelnetMessageNegotiation>) {
+                    return 3;
+                } else {
+                    return 2;
+                }
+            }, std::get<TelnetMessage>(msg));
+        }
+
+        // the package a GMCP message is for, or nullopt if msg isn't GMCP.
+        std::optional<std::string_view> gmcp_package(const TelnetOutgoingMessage& msg) {
+            auto* telnet_msg = std::get_if<TelnetMessage>(&msg);
+            if (!telnet_msg) {
+                return std::nullopt;
+            }
+            if (auto* prepared = std::get_if<TelnetMessagePreparedGMCP>(telnet_msg)) {
+                if (prepared->gmcp) {
+                    return std::string_view(prepared->gmcp->package);
+                }
+            } else if (auto* gmcp = std::get_if<TelnetMessageGMCP>(telnet_msg)) {
+                return std::string_view(gmcp->package);
+            } else if (auto* sub = std::get_if<TelnetMessageSubnegotiation>(telnet_msg); sub && sub->option == codes::GMCP) {
+                std::string_view data(sub->data);
+                return data.substr(0, data.find(' '));
+            }
+            return std::nullopt;
+        }
+
+        bool is_text(const TelnetOutgoingMessage& msg) {
+            auto* telnet_msg = std::get_if<TelnetMessage>(&msg);
+            return telnet_msg && (std::holds_alternative<TelnetMessageData>(*telnet_msg) ||
+                std::holds_alternative<TelnetMessageBuffer>(*telnet_msg) ||
+                std::holds_alternative<TelnetMessageWire>(*telnet_msg));
+        }
+
+        bool is_droppable(const TelnetOutgoingMessage& msg) {
+            return is_text(msg) || gmcp_package(msg).has_value();
+        }
+    }
+
+    OutgoingQueue::OutgoingQueue(boost::asio::any_io_executor executor, OutputLimits limits)
+        : limits_(std::move(limits)), queue_(std::move(executor)) {
+    }
+
+    OutputQueueTotals output_queue_totals() {
+        return OutputQueueTotals{
+            .queued_bytes = total_queued_bytes.load(std::memory_order_relaxed),
+            .queued_messages = total_queued_messages.load(std::memory_order_relaxed),
+            .dropped_messages = total_dropped.load(std::memory_order_relaxed),
+            .collapsed_messages = total_collapsed.load(std::memory_order_relaxed),
+        };
+    }
+
+    OutgoingQueue::~OutgoingQueue() {
+        wake_room_waiters(boost::asio::error::eof);
+        // whatever the writer never got to leaves the totals with the queue.
+        total_queued_bytes.fetch_sub(queued_bytes_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        total_queued_messages.fetch_sub(queued_messages_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    PushResult OutgoingQueue::push(TelnetOutgoingMessage msg, bool counts_as_activity) {
+        return push(std::move(msg), counts_as_activity, limits_.policy != SlowClientPolicy::block);
+    }
+
+    PushResult OutgoingQueue::try_push(TelnetOutgoingMessage msg) {
+        return push(std::move(msg), true, true);
+    }
+
+    PushResult OutgoingQueue::push(TelnetOutgoingMessage msg, bool counts_as_activity, bool bounded) {
+        if (queue_.is_closed()) {
+            return PushResult::closed;
+        }
+
+        Entry entry{std::move(msg), 0, 0};
+        entry.bytes = message_bytes(entry.msg);
+
+        if (bounded && is_droppable(entry.msg) &&
+            queued_bytes_.load(std::memory_order_relaxed) + entry.bytes > limits_.hard_limit) {
+            // the writer is stuck and can't shed anything; refuse the new output instead.
+            dropped_messages_.fetch_add(1, std::memory_order_relaxed);
+            total_dropped.fetch_add(1, std::memory_order_relaxed);
+            return PushResult::dropped;
+        }
+
+        if (limits_.policy == SlowClientPolicy::collapse_gmcp) {
+            if (auto package = gmcp_package(entry.msg)) {
+                std::lock_guard lock(gmcp_mutex_);
+                entry.gmcp_sequence = ++gmcp_sequence_;
+                gmcp_latest_[std::string(*package)] = entry.gmcp_sequence;
+            }
+        }
+
+        const auto bytes = entry.bytes;
+        queued_bytes_.fetch_add(bytes, std::memory_order_seq_cst);
+        queued_messages_.fetch_add(1, std::memory_order_relaxed);
+        total_queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        total_queued_messages.fetch_add(1, std::memory_order_relaxed);
+        if (!queue_.push(std::move(entry))) {
+            release(bytes);
+            return PushResult::closed;
+        }
+
+        if (counts_as_activity && !active_.load(std::memory_order_relaxed)) {
+            active_.store(true, std::memory_order_relaxed);
+        }
+
+        const auto total = queued_bytes_.load(std::memory_order_relaxed);
+        auto peak = peak_bytes_.load(std::memory_order_relaxed);
+        while (total > peak && !peak_bytes_.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {
+        }
+        if (total > limits_.high_water) {
+            boost::asio::steady_timer::duration::rep none = 0;
+            congested_since_.compare_exchange_strong(none,
+                boost::asio::steady_timer::clock_type::now().time_since_epoch().count(), std::memory_order_relaxed);
+        }
+        return PushResult::queued;
+    }
+
+    void OutgoingQueue::close() {
+        queue_.close();
+        wake_room_waiters(boost::asio::error::eof);
+    }
+
+    boost::asio::awaitable<std::expected<TelnetOutgoingMessage, boost::system::error_code>> OutgoingQueue::receive(boost::asio::cancellation_slot slot) {
+        for (;;) {
+            auto entry = co_await queue_.receive(slot);
+            if (!entry) {
+                co_return std::unexpected(entry.error());
+            }
+            const bool drop = shed(*entry);
+            release(entry->bytes);
+            if (!drop) {
+                co_return std::move(entry->msg);
+            }
+        }
+    }
+
+    bool OutgoingQueue::shed(const Entry& entry) {
+        const auto before = queued_bytes_.load(std::memory_order_relaxed);
+        if (before > limits_.high_water) {
+            shedding_ = true;
+        } else if (before - entry.bytes <= limits_.high_water / 2) {
+            shedding_ = false;
+        }
+
+        bool superseded = false;
+        if (entry.gmcp_sequence != 0) {
+            auto package = gmcp_package(entry.msg);
+            std::lock_guard lock(gmcp_mutex_);
+            auto found = gmcp_latest_.find(std::string(*package));
+            if (found != gmcp_latest_.end() && found->second == entry.gmcp_sequence) {
+                gmcp_latest_.erase(found);
+            } else {
+                superseded = true;
+            }
+        }
+
+        if (!shedding_) {
+            return false;
+        }
+
+        switch (limits_.policy) {
+            case SlowClientPolicy::drop_oldest:
+                if (is_droppable(entry.msg)) {
+                    dropped_messages_.fetch_add(1, std::memory_order_relaxed);
+                    total_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                return false;
+            case SlowClientPolicy::collapse_gmcp:
+                if (superseded) {
+                    collapsed_messages_.fetch_add(1, std::memory_order_relaxed);
+                    total_collapsed.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                return false;
+            default:
+                return false;
+        }
+    }
+
+    void OutgoingQueue::release(std::size_t bytes) {
+        const auto remaining = queued_bytes_.fetch_sub(bytes, std::memory_order_seq_cst) - bytes;
+        queued_messages_.fetch_sub(1, std::memory_order_relaxed);
+        total_queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        total_queued_messages.fetch_sub(1, std::memory_order_relaxed);
+        if (remaining <= limits_.high_water) {
+            congested_since_.store(0, std::memory_order_relaxed);
+        }
+        if (remaining <= limits_.high_water / 2 && room_waiting_.load(std::memory_order_seq_cst)) {
+            wake_room_waiters({});
+        }
+    }
+
+    void OutgoingQueue::wake_room_waiters(boost::system::error_code ec) {
+        std::vector<RoomWaiter> waiters;
+        {
+            std::lock_guard lock(room_mutex_);
+            waiters.swap(room_waiters_);
+            room_waiting_.store(false, std::memory_order_seq_cst);
+        }
+        for (auto& waiter : waiters) {
+            waiter(ec);
+        }
+    }
+
+    boost::asio::steady_timer::duration OutgoingQueue::congested_for(boost::asio::steady_timer::time_point now) const {
+        const auto since = congested_since_.load(std::memory_order_relaxed);
+        if (since == 0 || queued_bytes_.load(std::memory_order_relaxed) <= limits_.high_water) {
+            return {};
+        }
+        const auto elapsed = now.time_since_epoch() - boost::asio::steady_timer::duration(since);
+        return elapsed > boost::asio::steady_timer::duration::zero() ? elapsed : boost::asio::steady_timer::duration::zero();
+    }
+
+    OutputQueueStats OutgoingQueue::stats() const {
+        return OutputQueueStats{
+            .queued_bytes = queued_bytes_.load(std::memory_order_relaxed),
+            .queued_messages = queued_messages_.load(std::memory_order_relaxed),
+            .peak_bytes = peak_bytes_.load(std::memory_order_relaxed),
+            .dropped_messages = dropped_messages_.load(std::memory_order_relaxed),
+            .collapsed_messages = collapsed_messages_.load(std::memory_order_relaxed),
+            .congested_for = congested_for(boost::asio::steady_timer::clock_type::now()),
+        };
+    }
+}
@@ -0,0 +1,273 @@
+#include "volcano/telnet/SessionRecording.hpp"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace volcano::telnet {
+
+    struct SessionRecorder::Sink {
+        std::mutex mutex;
+        std::FILE* file{nullptr};
+        std::vector<char> buffer;
+        std::string pending;
+        bool queued{false};
+        bool failed{false};
+
+        ~Sink() {
+            // fclose flushes into buffer's storage, so it has to happen before the vector goes.
+            if (file) {
+                std::fclose(file);
+            }
+        }
+    };
+
+    namespace {
+        constexpr std::size_t write_buffer_size = 64 * 1024;
+        // a recorder whose disk can't keep up stops recording rather than growing without bound.
+        constexpr std::size_t max_pending_bytes = 4 * 1024 * 1024;
+
+        // one thread does the file I/O for every recorder in the process.
+        class BackgroundWriter {
+            public:
+            BackgroundWriter() : thread_([this] { run(); }) {
+            }
+
+            ~BackgroundWriter() {
+                {
+                    std::lock_guard lock(mutex_);
+                    stopping_ = true;
+                }
+                wake_.notify_one();
+                thread_.join();
+            }
+
+            void enqueue(std::shared_ptr<SessionRecorder::Sink> sink) {
+                {
+                    std::lock_guard lock(mutex_);
+                    queue_.push_back(std::move(sink));
+                }
+                wake_.notify_one();
+            }
+
+            private:
+            void run() {
+                std::string chunk;
+                for (;;) {
+                    std::shared_ptr<SessionRecorder::Sink> sink;
+                    {
+                        std::unique_lock lock(mutex_);
+                        wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                        if (queue_.empty()) {
+                            return;
+                        }
+                        sink = std::move(queue_.front());
+                        queue_.pop_front();
+                    }
+                    {
+                        std::lock_guard lock(sink->mutex);
+                        chunk.swap(sink->pending);
+                        sink->queued = false;
+                    }
+                    if (!chunk.empty() && std::fwrite(chunk.data(), chunk.size(), 1, sink->file) != 1) {
+                        // a full disk shouldn't take the connection down; just stop recording it.
+                        std::lock_guard lock(sink->mutex);
+                        sink->failed = true;
+                        sink->pending.clear();
+                    }
+                    chunk.clear();
+                }
+            }
+
+            std::mutex mutex_;
+            std::condition_variable wake_;
+            std::deque<std::shared_ptr<SessionRecorder::Sink>> queue_;
+            bool stopping_{false};
+            std::thread thread_;
+        };
+
+        BackgroundWriter& background_writer() {
+            static BackgroundWriter writer;
+            return writer;
+        }
+
+        void release_mapping(const char* data, std::size_t size) {
+    #if defined(_WIN32)
+            (void)size;
+            delete[] data;
+    #else
+            ::munmap(const_cast<char*>(data), size);
+    #endif
+        }
+    }
+
+    std::unique_ptr<SessionRecorder> SessionRecorder::open(const std::filesystem::path& path, std::int64_t connection_id) {
+        auto sink = std::make_shared<Sink>();
+        sink->file = std::fopen(path.string().c_str(), "wb");
+        if (!sink->file) {
+            return nullptr;
+        }
+
+        sink->buffer.resize(write_buffer_size);
+        std::setvbuf(sink->file, sink->buffer.data(), _IOFBF, sink->buffer.size());
+
+        RecordingHeader header{};
+        std::memcpy(header.magic, recording_magic, sizeof(header.magic));
+        header.version = recording_version;
+        header.connection_id = connection_id;
+        header.started_unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (std::fwrite(&header, sizeof(header), 1, sink->file) != 1) {
+            return nullptr;
+        }
+
+        return std::unique_ptr<SessionRecorder>(new SessionRecorder(std::move(sink)));
+    }
+
+    SessionRecorder::SessionRecorder(std::shared_ptr<Sink> sink)
+        : sink_(std::move(sink)), started_(std::chrono::steady_clock::now()) {
+    }
+
+    // if a write is still queued, the writer holds the last sink reference and closes the file after it.
+    SessionRecorder::~SessionRecorder() = default;
+
+    void SessionRecorder::record(RecordKind kind, std::string_view payload) {
+        RecordHeader header{};
+        header.kind = kind;
+        header.length = static_cast<std::uint32_t>(payload.size());
+        header.offset_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started_).count();
+
+        bool wake = false;
+        {
+            std::lock_guard lock(sink_->mutex);
+            if (sink_->failed) {
+                return;
+            }
+            if (sink_->pending.size() + sizeof(header) + payload.size() > max_pending_bytes) {
+                sink_->failed = true;
+                sink_->pending.clear();
+                return;
+            }
+            sink_->pending.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            sink_->pending.append(payload);
+            wake = !std::exchange(sink_->queued, true);
+        }
+        if (wake) {
+            background_writer().enqueue(sink_);
+        }
+    }
+
+    std::expected<SessionRecording, std::string> SessionRecording::open(const std::filesystem::path& path) {
+    #if defined(_WIN32)
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return std::unexpected(std::string("cannot open file"));
+        }
+        const auto size = static_cast<std::size_t>(file.tellg());
+        if (size < sizeof(RecordingHeader)) {
+            return std::unexpected("file too small for a recording header");
+        }
+        auto* mapped = new char[size];
+        file.seekg(0);
+        if (!file.read(mapped, static_cast<std::streamsize>(size))) {
+            delete[] mapped;
+            return std::unexpected(std::string("read failed"));
+        }
+    #else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::unexpected(std::strerror(errno));
+        }
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            return std::unexpected(std::strerror(err));
+        }
+        const auto size = static_cast<std::size_t>(st.st_size);
+        if (size < sizeof(RecordingHeader)) {
+            ::close(fd);
+            return std::unexpected("file too small for a recording header");
+        }
+
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return std::unexpected(std::strerror(errno));
+        }
+        ::madvise(mapped, size, MADV_SEQUENTIAL);
+    #endif
+
+        SessionRecording recording(static_cast<const char*>(mapped), size);
+        if (std::memcmp(recording.header_.magic, recording_magic, sizeof(recording_magic)) != 0) {
+            return std::unexpected("not a session recording");
+        }
+        if (recording.header_.version != recording_version) {
+            return std::unexpected("unsupported recording version");
+        }
+        return recording;
+    }
+
+    SessionRecording::SessionRecording(const char* data, std::size_t size) : data_(data), size_(size) {
+        std::memcpy(&header_, data_, sizeof(header_));
+    }
+
+    SessionRecording::SessionRecording(SessionRecording&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), header_(other.header_) {
+    }
+
+    SessionRecording& SessionRecording::operator=(SessionRecording&& other) noexcept {
+        if (this != &other) {
+            if (data_) {
+                release_mapping(data_, size_);
+            }
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            header_ = other.header_;
+        }
+        return *this;
+    }
+
+    SessionRecording::~SessionRecording() {
+        if (data_) {
+            release_mapping(data_, size_);
+        }
+    }
+
+    std::vector<RecordView> SessionRecording::records() const {
+        std::vector<RecordView> out;
+        std::size_t pos = sizeof(RecordingHeader);
+        while (pos + sizeof(RecordHeader) <= size_) {
+            RecordHeader header;
+            std::memcpy(&header, data_ + pos, sizeof(header));
+            pos += sizeof(header);
+            if (header.length > size_ - pos) {
+                break;
+            }
+            out.push_back(RecordView{
+                header.kind,
+                std::chrono::nanoseconds(header.offset_ns),
+                std::string_view(data_ + pos, header.length),
+            });
+            pos += header.length;
+        }
+        return out;
+    }
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace volcano::util {
+
+    // Power-of-two size classes from min_block to max_block bytes. Freed blocks are
+    // kept on a per-thread free list (up to max_cached_bytes_per_thread) so that
+    // connection buffers growing and shrinking reuse memory instead of going back
+    // to the heap. Larger requests bypass the pool.
+    struct BufferPoolOptions {
+        std::size_t min_block{1024};
+        std::size_t max_block{1024 * 1024};
+        std::size_t max_cached_bytes_per_thread{4 * 1024 * 1024};
+    };
+
+    extern BufferPoolOptions buffer_pool_options;
+
+    struct BufferPoolStats {
+        // bytes currently handed out to buffers, across all threads.
+        std::size_t reserved_bytes{0};
+        // bytes sitting on free lists, across all threads.
+        std::size_t cached_bytes{0};
+        std::uint64_t allocations{0};
+        std::uint64_t reused{0};
+    };
+
+    void* pool_allocate(std::size_t bytes);
+    void pool_deallocate(void* block, std::size_t bytes) noexcept;
+
+    BufferPoolStats buffer_pool_stats();
+
+    // std-style allocator over the pool, for containers such as beast::basic_flat_buffer.
+    template<typename T>
+    class PoolAllocator {
+        public:
+        using value_type = T;
+
+        PoolAllocator() noexcept = default;
+
+        template<typename U>
+        PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(pool_allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept {
+            pool_deallocate(p, n * sizeof(T));
+        }
+
+        template<typename U>
+        bool operator==(const PoolAllocator<U>&) const noexcept {
+            return true;
+        }
+    };
+
+}
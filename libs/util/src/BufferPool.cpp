@@ -0,0 +1,106 @@
+#include <volcano/util/BufferPool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+
+namespace volcano::util {
+
+    BufferPoolOptions buffer_pool_options;
+
+    namespace {
+        constexpr std::size_t max_classes = 32;
+
+        std::atomic<std::size_t> reserved_bytes{0};
+        std::atomic<std::size_t> cached_bytes{0};
+        std::atomic<std::uint64_t> allocations{0};
+        std::atomic<std::uint64_t> reused{0};
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        struct ThreadCache {
+            std::array<FreeBlock*, max_classes> heads{};
+            std::size_t bytes{0};
+
+            ~ThreadCache() {
+                for (std::size_t index = 0; index < heads.size(); ++index) {
+                    while (auto* block = heads[index]) {
+                        heads[index] = block->next;
+                        ::operator delete(block);
+                    }
+                }
+                cached_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+            }
+        };
+
+        thread_local ThreadCache cache;
+
+        // the class a request of this size is served from; only valid when it fits under max_block.
+        std::size_t class_size(std::size_t bytes) {
+            return std::bit_ceil(std::max(bytes, buffer_pool_options.min_block));
+        }
+
+        std::size_t class_index(std::size_t size) {
+            return static_cast<std::size_t>(std::countr_zero(size));
+        }
+
+        bool pooled(std::size_t bytes) {
+            return bytes <= buffer_pool_options.max_block;
+        }
+    }
+
+    void* pool_allocate(std::size_t bytes) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if (!pooled(bytes)) {
+            reserved_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            return ::operator new(bytes);
+        }
+
+        const auto size = class_size(bytes);
+        reserved_bytes.fetch_add(size, std::memory_order_relaxed);
+        auto& head = cache.heads[class_index(size)];
+        if (auto* block = head) {
+            head = block->next;
+            cache.bytes -= size;
+            cached_bytes.fetch_sub(size, std::memory_order_relaxed);
+            reused.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+        return ::operator new(size);
+    }
+
+    void pool_deallocate(void* block, std::size_t bytes) noexcept {
+        if (!block) {
+            return;
+        }
+        if (!pooled(bytes)) {
+            reserved_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+            ::operator delete(block);
+            return;
+        }
+
+        const auto size = class_size(bytes);
+        reserved_bytes.fetch_sub(size, std::memory_order_relaxed);
+        if (cache.bytes + size > buffer_pool_options.max_cached_bytes_per_thread) {
+            ::operator delete(block);
+            return;
+        }
+        auto& head = cache.heads[class_index(size)];
+        head = new (block) FreeBlock{head};
+        cache.bytes += size;
+        cached_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    BufferPoolStats buffer_pool_stats() {
+        return BufferPoolStats{
+            .reserved_bytes = reserved_bytes.load(std::memory_order_relaxed),
+            .cached_bytes = cached_bytes.load(std::memory_order_relaxed),
+            .allocations = allocations.load(std::memory_order_relaxed),
+            .reused = reused.load(std::memory_order_relaxed),
+        };
+    }
+
+}
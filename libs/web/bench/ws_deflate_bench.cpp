@@ -0,0 +1,168 @@
+// Measures permessage-deflate on a synthetic game-output stream: each message is one
+// WebSocket text frame from server to client, the way a web client receives room
+// text, combat spam, chat and prompts. Reports wire bytes and server/client CPU
+// per profile so WebSocketOptions for a route can be picked with numbers.
+//
+//   volcano_web_ws_bench [messages]
+
+#include <volcano/web/Base.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/beast/_experimental/test/stream.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+    namespace beast = boost::beast;
+    namespace websocket = boost::beast::websocket;
+
+    std::vector<std::string> make_corpus(std::size_t messages) {
+        static const char* rooms[] = {
+            "The Temple Square",
+            "A Narrow Alley Behind the Smithy",
+            "The Eastern Gate of Midgaard",
+            "Inside the Dusty Library",
+        };
+        static const char* words[] = {
+            "the", "a", "stone", "ancient", "light", "shadows", "north", "south", "guard",
+            "flickers", "across", "walls", "you", "see", "here", "dragon", "sword", "gold",
+        };
+        static const char* colors[] = {"\x1b[0m", "\x1b[1;32m", "\x1b[0;36m", "\x1b[1;31m", "\x1b[38;5;208m"};
+
+        std::mt19937 rng(1280);
+        std::vector<std::string> out;
+        out.reserve(messages);
+
+        for (std::size_t i = 0; i < messages; ++i) {
+            std::string msg;
+            switch (rng() % 4) {
+                case 0: {
+                    msg += colors[1];
+                    msg += rooms[rng() % std::size(rooms)];
+                    msg += colors[0];
+                    msg += "\r\n";
+                    for (int w = 0; w < 60; ++w) {
+                        msg += words[rng() % std::size(words)];
+                        msg += (w % 12 == 11) ? "\r\n" : " ";
+                    }
+                    msg += "\r\n[Exits: north south east]\r\n";
+                    break;
+                }
+                case 1:
+                    msg += colors[3];
+                    msg += "You hit the dragon for ";
+                    msg += std::to_string(rng() % 200);
+                    msg += " damage!";
+                    msg += colors[0];
+                    msg += "\r\n";
+                    break;
+                case 2:
+                    msg += colors[4];
+                    msg += "[Chat] Someone: ";
+                    for (int w = 0; w < 8; ++w) {
+                        msg += words[rng() % std::size(words)];
+                        msg += ' ';
+                    }
+                    msg += colors[0];
+                    msg += "\r\n";
+                    break;
+                default:
+                    msg += colors[2];
+                    msg += "<" + std::to_string(rng() % 1000) + "hp " + std::to_string(rng() % 500) + "m> ";
+                    msg += colors[0];
+                    break;
+            }
+            out.push_back(std::move(msg));
+        }
+        return out;
+    }
+
+    double cpu_micros() {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) * 1e6 + static_cast<double>(ts.tv_nsec) / 1e3;
+    }
+
+    void run_profile(const char* name, const std::vector<std::string>& corpus, const volcano::web::WebSocketOptions& options) {
+        boost::asio::io_context ioc;
+        websocket::stream<beast::test::stream> server(ioc);
+        websocket::stream<beast::test::stream> client(ioc);
+        server.next_layer().connect(client.next_layer());
+
+        const auto server_pmd = volcano::web::permessage_deflate_for(options);
+        server.set_option(server_pmd);
+
+        // a browser offers deflate with default windows.
+        websocket::permessage_deflate client_pmd;
+        client_pmd.client_enable = true;
+        client.set_option(client_pmd);
+
+        server.async_accept([](beast::error_code ec) {
+            if (ec) {
+                std::fprintf(stderr, "accept: %s\n", ec.message().c_str());
+            }
+        });
+        client.async_handshake("localhost", "/ws", [](beast::error_code ec) {
+            if (ec) {
+                std::fprintf(stderr, "handshake: %s\n", ec.message().c_str());
+            }
+        });
+        ioc.run();
+
+        const std::size_t handshake_bytes = client.next_layer().nread_bytes();
+        std::size_t raw = 0;
+        double server_cpu = 0;
+        double client_cpu = 0;
+        beast::flat_buffer buffer;
+
+        for (const auto& msg : corpus) {
+            raw += msg.size();
+
+            double started = cpu_micros();
+            server.write(boost::asio::buffer(msg));
+            server_cpu += cpu_micros() - started;
+
+            started = cpu_micros();
+            client.read(buffer);
+            client_cpu += cpu_micros() - started;
+            buffer.consume(buffer.size());
+        }
+
+        const std::size_t wire = client.next_layer().nread_bytes() - handshake_bytes;
+        std::printf("%-22s %3d %3d %3d %8zu KB %10zu %10zu %7.3f %10.0f %10.0f %8.2f\n", name,
+                    server_pmd.server_max_window_bits, server_pmd.memLevel, server_pmd.compLevel,
+                    options.max_deflate_memory / 1024, raw, wire,
+                    static_cast<double>(wire) / static_cast<double>(raw), server_cpu, client_cpu,
+                    server_cpu / static_cast<double>(corpus.size()));
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t messages = 20000;
+    if (argc > 1) {
+        messages = std::stoul(argv[1]);
+    }
+
+    const auto corpus = make_corpus(messages);
+
+    std::printf("%-22s %3s %3s %3s %11s %10s %10s %7s %10s %10s %8s\n", "profile", "wb", "mem", "lvl", "cap",
+                "raw", "wire", "ratio", "server_us", "client_us", "us/msg");
+
+    run_profile("off", corpus, {});
+    run_profile("default", corpus, {.deflate = true});
+    run_profile("fast", corpus, {.deflate = true, .level = 1});
+    run_profile("no context takeover", corpus,
+                {.deflate = true, .server_no_context_takeover = true, .client_no_context_takeover = true});
+    run_profile("small window", corpus, {.deflate = true, .server_max_window_bits = 10, .mem_level = 3});
+    run_profile("capped 64 KB", corpus, {.deflate = true, .mem_level = 8, .max_deflate_memory = 64 * 1024});
+    run_profile("capped 16 KB", corpus, {.deflate = true, .mem_level = 8, .max_deflate_memory = 16 * 1024});
+
+    return 0;
+}
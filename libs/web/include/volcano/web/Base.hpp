@@ -27,6 +27,24 @@ namespace volcano::web
         std::string content_type = "text/plain";
     };
 
+    // Per-route WebSocket settings, given to Router::add_websocket_handler.
+    struct WebSocketOptions {
+        // permessage-deflate (RFC 7692), used when the client offers it.
+        bool deflate{false};
+        int server_max_window_bits{15};
+        // below 15, clients that don't offer client_max_window_bits are refused deflate.
+        int client_max_window_bits{15};
+        bool server_no_context_takeover{false};
+        bool client_no_context_takeover{false};
+        int level{6};
+        int mem_level{4};
+        // upper bound on zlib state per connection, in bytes (0 = no cap). The
+        // server window and then mem_level are lowered until the estimate fits.
+        std::size_t max_deflate_memory{0};
+    };
+
+    boost::beast::websocket::permessage_deflate permessage_deflate_for(const WebSocketOptions& options);
+
     using Parameters = std::unordered_map<std::string, std::string>;
 
     struct ClientInfo {
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Base.hpp"
+
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+namespace volcano::web {
+
+    // Wire encodings for nlohmann::json bodies. CBOR and MessagePack are picked by
+    // Content-Type/Accept; anything unrecognised is treated as JSON text.
+    enum class BodyFormat {
+        json,
+        cbor,
+        msgpack
+    };
+
+    struct BodyFormatOptions {
+        // encoding for request bodies built by the portal. A target that answers 415
+        // gets JSON from then on.
+        BodyFormat requests{BodyFormat::json};
+        // preferred in Accept; JSON stays acceptable, so older servers keep working.
+        BodyFormat responses{BodyFormat::cbor};
+    };
+
+    extern BodyFormatOptions body_format_options;
+
+    std::string_view content_type_for(BodyFormat format);
+    std::optional<BodyFormat> body_format_from_content_type(std::string_view content_type);
+
+    // Accept value preferring format, with JSON as the fallback.
+    std::string accept_for(BodyFormat format);
+
+    // Best format a client accepts, from its Accept header.
+    BodyFormat negotiate_body_format(std::string_view accept);
+
+    std::string encode_body(const nlohmann::json& j, BodyFormat format);
+    std::expected<nlohmann::json, std::string> decode_body(std::string_view body, BodyFormat format);
+
+    // Answer in whatever encoding req's Accept prefers.
+    HttpAnswer make_json_answer(const HttpRequest& req, http::status status, const nlohmann::json& j);
+
+    // Re-encodes a CBOR/MessagePack request body as JSON; false if it couldn't be decoded.
+    bool transcode_to_json(HttpRequest& req);
+
+} // namespace volcano::web
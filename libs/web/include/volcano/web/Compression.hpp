@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Base.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace volcano::web {
+
+    // Content-Encoding for HTTP bodies. The router compresses answers the client
+    // accepts; HttpSession advertises gzip/deflate and inflates what comes back.
+    struct CompressionOptions {
+        bool enabled{true};
+        // bodies smaller than this go out as-is; the framing would eat most of the win.
+        std::size_t min_size{1024};
+        int level{6};
+        // Content-Type prefixes worth compressing. Images, archives and the like are already compressed.
+        std::vector<std::string> content_types{
+            "text/", "application/json", "application/javascript", "application/xml", "image/svg+xml",
+        };
+        // HttpSession sends Accept-Encoding and decompresses responses.
+        bool client_accept_encoding{true};
+        // a response that inflates past this is rejected rather than buffered.
+        std::size_t max_inflated_size{64 * 1024 * 1024};
+    };
+
+    extern CompressionOptions compression_options;
+
+    struct CompressionStats {
+        std::uint64_t responses_compressed{0};
+        // body bytes before and after compression, for responses the router compressed.
+        std::uint64_t response_bytes_in{0};
+        std::uint64_t response_bytes_out{0};
+        std::uint64_t responses_inflated{0};
+        // wire and inflated body bytes, for responses HttpSession decompressed.
+        std::uint64_t inflated_bytes_in{0};
+        std::uint64_t inflated_bytes_out{0};
+
+        // negative when received bodies inflated to less than they took on the wire.
+        [[nodiscard]] std::int64_t bytes_saved() const {
+            return (static_cast<std::int64_t>(response_bytes_in) - static_cast<std::int64_t>(response_bytes_out)) +
+                   (static_cast<std::int64_t>(inflated_bytes_out) - static_cast<std::int64_t>(inflated_bytes_in));
+        }
+    };
+
+    CompressionStats compression_stats();
+
+    enum class ContentCoding {
+        identity,
+        gzip,
+        deflate
+    };
+
+    // Picks a coding from an Accept-Encoding value, honouring q-values; gzip wins ties.
+    ContentCoding negotiate_encoding(std::string_view accept_encoding);
+
+    bool is_compressible_type(std::string_view content_type);
+
+    // Compresses res's body in place when req accepts a coding and the body is big
+    // enough and of an allowed type. Call before prepare_payload().
+    void compress_response(const HttpRequest& req, HttpResponse& res);
+
+    // Undoes a gzip or deflate Content-Encoding on a received response.
+    std::expected<void, std::string> decompress_response(HttpResponse& res);
+
+} // namespace volcano::web
@@ -8,12 +8,14 @@
 
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 #include <chrono>
 #include <expected>
 #include <system_error>
@@ -69,6 +71,64 @@ namespace volcano::web {
         std::chrono::milliseconds request_timeout{std::chrono::seconds(30)};
     };
 
+    // Sizing for pools made by HttpSessionPools::pool_for when no options are given.
+    // These pools are shared by every client of a target, so they are larger than a
+    // default-constructed HttpPoolOptions.
+    extern HttpPoolOptions http_pool_options;
+
+    struct HttpPoolStats {
+        // sessions currently counted against max_sessions.
+        std::size_t open_sessions{0};
+        std::uint64_t created{0};
+        // acquisitions served by an idle keep-alive session.
+        std::uint64_t reused{0};
+        // acquisitions that had to wait for a session to be released.
+        std::uint64_t waits{0};
+        std::chrono::microseconds wait_time{0};
+    };
+
+    // Opt-in deduplication for HttpClient::request. Identical GETs in flight at the
+    // same time (same target, path and vary_headers values) share one backend
+    // request, and with cache_ttl set a 200 answers repeats for that long afterwards.
+    // A GET carrying any header outside vary_headers and a few neutral ones (Host,
+    // User-Agent, Connection, Cache-Control...) is never shared, so credentials such as
+    // Cookie only take part when listed here. Cache-Control private/no-store responses
+    // are never cached.
+    //
+    // Callers that want sharing must build the request without per-caller headers:
+    // X-Forwarded-For, Cookie, and Authorization (which is in the key, so it only
+    // shares between holders of the same token). Host is in the key too, so it must
+    // name the backend rather than anything about the caller.
+    struct RequestCoalescingOptions {
+        bool enabled{false};
+        // lower-case names of request headers that change the response; they form the key.
+        std::vector<std::string> vary_headers{"authorization", "accept", "accept-encoding", "accept-language"};
+        // zero turns the cache off and leaves only the in-flight sharing.
+        std::chrono::milliseconds cache_ttl{0};
+        std::size_t cache_max_entries{256};
+        // body bytes held by the cache.
+        std::size_t cache_max_bytes{4 * 1024 * 1024};
+    };
+
+    extern RequestCoalescingOptions request_coalescing_options;
+
+    struct RequestCoalescingStats {
+        // GETs that went through the coalescing layer.
+        std::uint64_t requests{0};
+        // requests that went to the backend on behalf of themselves and any waiters.
+        std::uint64_t fetched{0};
+        // requests answered by another request already in flight.
+        std::uint64_t coalesced{0};
+        std::uint64_t cache_hits{0};
+        std::size_t cache_entries{0};
+        std::size_t cache_bytes{0};
+    };
+
+    RequestCoalescingStats request_coalescing_stats();
+
+    // Whether HttpClient::request would share or cache this request under the current options.
+    bool request_is_coalescable(const HttpRequest& request);
+
     class HttpSession {
     public:
         explicit HttpSession(HttpTarget target, std::shared_ptr<boost::asio::ssl::context> tls_context = {});
@@ -111,26 +171,75 @@ namespace volcano::web {
             return options_;
         }
 
-        boost::asio::awaitable<std::shared_ptr<HttpSession>> acquire();
+        // Waits at most timeout (default options().request_timeout) for a session when
+        // the pool is at max_sessions; throws if none comes free in time.
+        boost::asio::awaitable<std::shared_ptr<HttpSession>> acquire(
+            std::optional<std::chrono::milliseconds> timeout = std::nullopt);
         void release(const std::shared_ptr<HttpSession>& session);
 
+        [[nodiscard]] HttpPoolStats stats() const;
+
+        // Set once the target has answered a CBOR/MessagePack body with 415.
+        [[nodiscard]] bool json_bodies_only() const {
+            return json_bodies_only_.load(std::memory_order_relaxed);
+        }
+
+        void set_json_bodies_only() {
+            json_bodies_only_.store(true, std::memory_order_relaxed);
+        }
+
     private:
         HttpTarget target_;
         HttpPoolOptions options_;
         std::atomic<std::size_t> created_{0};
+        std::atomic<std::uint64_t> total_created_{0};
+        std::atomic<std::uint64_t> reused_{0};
+        std::atomic<std::uint64_t> waits_{0};
+        std::atomic<std::int64_t> wait_micros_{0};
+        std::atomic<bool> json_bodies_only_{false};
         std::mutex mutex_;
+        // acquirers parked on channel_; guarded by mutex_.
+        std::size_t waiting_{0};
+        // idle sessions, plus null entries standing for a free slot handed to a waiter.
         boost::asio::experimental::concurrent_channel<void(boost::system::error_code, std::shared_ptr<HttpSession>)> channel_;
     };
 
     class HttpSessionPools {
     public:
-        std::shared_ptr<HttpSessionPool> pool_for(const HttpTarget& target, HttpPoolOptions options = {});
+        // Pools are shared per target, Host header and TLS context; other options only
+        // apply when the pool is created here.
+        std::shared_ptr<HttpSessionPool> pool_for(const HttpTarget& target, HttpPoolOptions options = http_pool_options);
+
+        // totals across the pools that are still alive.
+        [[nodiscard]] HttpPoolStats stats();
 
     private:
+        struct PoolKey {
+            HttpTarget target;
+            std::shared_ptr<boost::asio::ssl::context> tls_context;
+
+            bool operator==(const PoolKey& other) const {
+                return target == other.target && target.host_header == other.target.host_header &&
+                       tls_context == other.tls_context;
+            }
+        };
+
+        struct PoolKeyHash {
+            std::size_t operator()(const PoolKey& key) const noexcept {
+                std::size_t seed = HttpTargetHash{}(key.target);
+                seed ^= std::hash<std::string>{}(key.target.host_header) + 0x9e3779b97f4a7c15ULL + (seed << 6U) + (seed >> 2U);
+                seed ^= std::hash<const void*>{}(key.tls_context.get()) + 0x9e3779b97f4a7c15ULL + (seed << 6U) + (seed >> 2U);
+                return seed;
+            }
+        };
+
         std::mutex mutex_;
-        std::unordered_map<HttpTarget, std::weak_ptr<HttpSessionPool>, HttpTargetHash> pools_;
+        std::unordered_map<PoolKey, std::weak_ptr<HttpSessionPool>, PoolKeyHash> pools_;
     };
 
+    // Process-wide registry, so every client of a target shares one pool of connections.
+    HttpSessionPools& shared_session_pools();
+
     class HttpClient {
     public:
         explicit HttpClient(std::shared_ptr<HttpSessionPool> pool);
@@ -145,6 +254,10 @@ namespace volcano::web {
             std::optional<std::chrono::milliseconds> timeout = std::nullopt);
 
     private:
+        boost::asio::awaitable<std::expected<HttpResponse, std::string>> send(
+            HttpRequest request,
+            std::optional<std::chrono::milliseconds> timeout);
+
         std::shared_ptr<HttpSessionPool> pool_;
     };
 
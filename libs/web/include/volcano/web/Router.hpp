@@ -22,8 +22,9 @@ namespace volcano::web {
         Router& add_router(std::string_view path);
         void add_request_handler(std::string_view path, http::verb verb, RequestHandler handler);
         void add_request_handler(std::string_view path, http::verb verb, EndpointGuard guard, RequestHandler handler);
-        void add_websocket_handler(std::string_view path, WebSocketHandler handler);
-        void add_websocket_handler(std::string_view path, EndpointGuard guard, WebSocketHandler handler);
+        void add_websocket_handler(std::string_view path, WebSocketHandler handler, WebSocketOptions options = {});
+        void add_websocket_handler(std::string_view path, EndpointGuard guard, WebSocketHandler handler,
+                                   WebSocketOptions options = {});
         void register_parameter(std::string_view type, std::string_view pattern);
         void register_parameter(std::string_view type, std::function<bool(std::string_view)> validator);
         void add_trusted_proxy(const boost::asio::ip::address& address);
@@ -44,6 +45,7 @@ namespace volcano::web {
         struct WebSocketEndpoint {
             EndpointGuard guard;
             WebSocketHandler handler;
+            WebSocketOptions options;
         };
 
         std::optional<std::reference_wrapper<RequestEndpoint>> request_handler(http::verb verb);
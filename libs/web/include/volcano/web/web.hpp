@@ -3,6 +3,7 @@
 #include <memory>
 #include <nlohmann/json.hpp>
 
+#include "BodyFormat.hpp"
 #include "Router.hpp"
 #include "HttpClient.hpp"
 
@@ -11,6 +12,8 @@ namespace volcano::web {
 
 volcano::net::ClientHandler make_router_handler(std::shared_ptr<Router> router);
 
+// Decodes a JSON, CBOR or MessagePack body according to its Content-Type.
 std::expected<nlohmann::json, std::string> parse_json_body(HttpRequest& req);
+std::expected<nlohmann::json, std::string> parse_json_body(const HttpResponse& res);
 
 } // namespace vol::web
@@ -0,0 +1,76 @@
+#pragma once
+
+// Helpers for comma-separated, q-weighted header values (Accept, Accept-Encoding).
+
+#include <volcano/web/Base.hpp>
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+namespace volcano::web::detail {
+
+    inline std::string_view trim(std::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        return value;
+    }
+
+    // q from a ";"-separated parameter list in thousandths: "q=0.5" -> 500; no q counts as 1.
+    inline int parse_quality(std::string_view params) {
+        while (!params.empty()) {
+            auto end = params.find(';');
+            auto param = trim(params.substr(0, end));
+            params = end == std::string_view::npos ? std::string_view{} : params.substr(end + 1);
+
+            if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=') {
+                continue;
+            }
+            auto value = param.substr(2);
+            if (value.empty() || value.front() == '1') {
+                return 1000;
+            }
+            int thousandths = 0;
+            if (value.size() > 2 && value[0] == '0' && value[1] == '.') {
+                auto digits = value.substr(2, 3);
+                int parsed = 0;
+                auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), parsed);
+                if (ec == std::errc{}) {
+                    thousandths = parsed;
+                    for (auto used = ptr - digits.data(); used < 3; ++used) {
+                        thousandths *= 10;
+                    }
+                }
+            }
+            return thousandths;
+        }
+        return 1000;
+    }
+
+    // Calls fn(token, q) for each item of a list such as "gzip;q=0.5, deflate".
+    template<typename F>
+    void for_each_weighted(std::string_view list, F&& fn) {
+        while (!list.empty()) {
+            auto end = list.find(',');
+            auto item = list.substr(0, end);
+            list = end == std::string_view::npos ? std::string_view{} : list.substr(end + 1);
+
+            auto semi = item.find(';');
+            auto token = trim(item.substr(0, semi));
+            if (!token.empty()) {
+                fn(token, semi == std::string_view::npos ? 1000 : parse_quality(item.substr(semi + 1)));
+            }
+        }
+    }
+
+    template<typename Fields>
+    std::string_view header_value(const Fields& fields, http::field name) {
+        auto value = fields[name];
+        return {value.data(), value.size()};
+    }
+
+} // namespace volcano::web::detail
@@ -0,0 +1,107 @@
+#include "volcano/web/BodyFormat.hpp"
+#include "HeaderValue.hpp"
+
+#include <boost/algorithm/string.hpp>
+
+namespace volcano::web {
+
+    BodyFormatOptions body_format_options;
+
+    std::string_view content_type_for(BodyFormat format) {
+        switch (format) {
+            case BodyFormat::cbor: return "application/cbor";
+            case BodyFormat::msgpack: return "application/msgpack";
+            default: return "application/json";
+        }
+    }
+
+    std::optional<BodyFormat> body_format_from_content_type(std::string_view content_type) {
+        auto media = detail::trim(content_type.substr(0, content_type.find(';')));
+        if (boost::iequals(media, "application/cbor")) {
+            return BodyFormat::cbor;
+        }
+        for (auto msgpack : {"application/msgpack", "application/x-msgpack", "application/vnd.msgpack"}) {
+            if (boost::iequals(media, msgpack)) {
+                return BodyFormat::msgpack;
+            }
+        }
+        if (boost::iequals(media, "application/json") || boost::iends_with(media, "+json")) {
+            return BodyFormat::json;
+        }
+        return std::nullopt;
+    }
+
+    std::string accept_for(BodyFormat format) {
+        if (format == BodyFormat::json) {
+            return "application/json";
+        }
+        return std::string(content_type_for(format)) + ", application/json;q=0.9";
+    }
+
+    BodyFormat negotiate_body_format(std::string_view accept) {
+        auto best = BodyFormat::json;
+        int best_q = 0;
+        detail::for_each_weighted(accept, [&](std::string_view media, int q) {
+            auto format = body_format_from_content_type(media);
+            // JSON wins ties, so a plain "*/*" or an equal preference stays on text.
+            if (format && (q > best_q || (q == best_q && *format == BodyFormat::json))) {
+                best = *format;
+                best_q = q;
+            }
+        });
+        return best;
+    }
+
+    std::string encode_body(const nlohmann::json& j, BodyFormat format) {
+        switch (format) {
+            case BodyFormat::cbor: {
+                std::string out;
+                nlohmann::json::to_cbor(j, out);
+                return out;
+            }
+            case BodyFormat::msgpack: {
+                std::string out;
+                nlohmann::json::to_msgpack(j, out);
+                return out;
+            }
+            default:
+                return j.dump();
+        }
+    }
+
+    std::expected<nlohmann::json, std::string> decode_body(std::string_view body, BodyFormat format) {
+        try {
+            switch (format) {
+                case BodyFormat::cbor:
+                    return nlohmann::json::from_cbor(body);
+                case BodyFormat::msgpack:
+                    return nlohmann::json::from_msgpack(body);
+                default:
+                    return nlohmann::json::parse(body);
+            }
+        } catch (const nlohmann::json::exception& e) {
+            return std::unexpected(std::string("Failed to parse body: ") + e.what());
+        }
+    }
+
+    HttpAnswer make_json_answer(const HttpRequest& req, http::status status, const nlohmann::json& j) {
+        auto format = negotiate_body_format(detail::header_value(req, http::field::accept));
+        return HttpAnswer{status, encode_body(j, format), std::string(content_type_for(format))};
+    }
+
+    bool transcode_to_json(HttpRequest& req) {
+        auto format = body_format_from_content_type(detail::header_value(req, http::field::content_type));
+        if (!format || *format == BodyFormat::json) {
+            return true;
+        }
+        auto decoded = decode_body(req.body(), *format);
+        if (!decoded) {
+            return false;
+        }
+        req.body() = decoded->dump();
+        req.set(http::field::content_type, content_type_for(BodyFormat::json));
+        req.prepare_payload();
+        return true;
+    }
+
+} // namespace volcano::web
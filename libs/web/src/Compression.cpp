@@ -0,0 +1,189 @@
+#include "volcano/web/Compression.hpp"
+#include "HeaderValue.hpp"
+
+#include <volcano/zlib/Zlib.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+#include <atomic>
+#include <span>
+#include <stdexcept>
+
+namespace volcano::web {
+
+    CompressionOptions compression_options;
+
+    namespace {
+        std::atomic<std::uint64_t> responses_compressed{0};
+        std::atomic<std::uint64_t> response_bytes_in{0};
+        std::atomic<std::uint64_t> response_bytes_out{0};
+        std::atomic<std::uint64_t> responses_inflated{0};
+        std::atomic<std::uint64_t> inflated_bytes_in{0};
+        std::atomic<std::uint64_t> inflated_bytes_out{0};
+
+        std::span<const std::byte> as_bytes(std::string_view text) {
+            return {reinterpret_cast<const std::byte*>(text.data()), text.size()};
+        }
+
+        // adds Accept-Encoding to whatever Vary the handler already set, unless it's listed or "*".
+        void add_vary_accept_encoding(HttpResponse& res) {
+            auto vary = detail::header_value(res, http::field::vary);
+            bool listed = false;
+            detail::for_each_weighted(vary, [&](std::string_view token, int) {
+                listed = listed || token == "*" || boost::iequals(token, "Accept-Encoding");
+            });
+            if (listed) {
+                return;
+            }
+            if (detail::trim(vary).empty()) {
+                res.set(http::field::vary, "Accept-Encoding");
+            } else {
+                res.set(http::field::vary, std::string(vary) + ", Accept-Encoding");
+            }
+        }
+
+        // RFC 9110 "deflate" is zlib-wrapped, but some servers send raw deflate.
+        bool has_zlib_header(std::string_view body) {
+            if (body.size() < 2) {
+                return false;
+            }
+            const auto cmf = static_cast<unsigned char>(body[0]);
+            const auto flg = static_cast<unsigned char>(body[1]);
+            return (cmf & 0x0f) == Z_DEFLATED && ((cmf << 8) | flg) % 31 == 0;
+        }
+    }
+
+    CompressionStats compression_stats() {
+        return CompressionStats{
+            .responses_compressed = responses_compressed.load(std::memory_order_relaxed),
+            .response_bytes_in = response_bytes_in.load(std::memory_order_relaxed),
+            .response_bytes_out = response_bytes_out.load(std::memory_order_relaxed),
+            .responses_inflated = responses_inflated.load(std::memory_order_relaxed),
+            .inflated_bytes_in = inflated_bytes_in.load(std::memory_order_relaxed),
+            .inflated_bytes_out = inflated_bytes_out.load(std::memory_order_relaxed),
+        };
+    }
+
+    ContentCoding negotiate_encoding(std::string_view accept_encoding) {
+        int gzip_q = -1;
+        int deflate_q = -1;
+        int any_q = -1;
+
+        detail::for_each_weighted(accept_encoding, [&](std::string_view coding, int q) {
+            if (boost::iequals(coding, "gzip") || boost::iequals(coding, "x-gzip")) {
+                gzip_q = q;
+            } else if (boost::iequals(coding, "deflate")) {
+                deflate_q = q;
+            } else if (coding == "*") {
+                any_q = q;
+            }
+        });
+
+        if (gzip_q < 0) {
+            gzip_q = any_q;
+        }
+        if (deflate_q < 0) {
+            deflate_q = any_q;
+        }
+        if (gzip_q > 0 && gzip_q >= deflate_q) {
+            return ContentCoding::gzip;
+        }
+        if (deflate_q > 0) {
+            return ContentCoding::deflate;
+        }
+        return ContentCoding::identity;
+    }
+
+    bool is_compressible_type(std::string_view content_type) {
+        content_type = detail::trim(content_type.substr(0, content_type.find(';')));
+        for (const auto& prefix : compression_options.content_types) {
+            if (boost::istarts_with(content_type, prefix)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void compress_response(const HttpRequest& req, HttpResponse& res) {
+        if (!compression_options.enabled || res.body().size() < compression_options.min_size) {
+            return;
+        }
+        if (res.find(http::field::content_encoding) != res.end() ||
+            !is_compressible_type(detail::header_value(res, http::field::content_type))) {
+            return;
+        }
+
+        // the body depends on Accept-Encoding from here on, whatever this client asked for.
+        add_vary_accept_encoding(res);
+
+        auto coding = negotiate_encoding(detail::header_value(req, http::field::accept_encoding));
+        if (coding == ContentCoding::identity) {
+            return;
+        }
+
+        std::vector<std::byte> compressed;
+        compressed.reserve(res.body().size() / 2);
+        zlib::compress(as_bytes(res.body()), compressed,
+                       coding == ContentCoding::gzip ? zlib::Format::gzip : zlib::Format::zlib,
+                       compression_options.level);
+        if (compressed.size() >= res.body().size()) {
+            return;
+        }
+
+        responses_compressed.fetch_add(1, std::memory_order_relaxed);
+        response_bytes_in.fetch_add(res.body().size(), std::memory_order_relaxed);
+        response_bytes_out.fetch_add(compressed.size(), std::memory_order_relaxed);
+
+        res.body().assign(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+        res.set(http::field::content_encoding, coding == ContentCoding::gzip ? "gzip" : "deflate");
+    }
+
+    std::expected<void, std::string> decompress_response(HttpResponse& res) {
+        if (res.find(http::field::content_encoding) == res.end()) {
+            return {};
+        }
+        // HEAD, 204 and 304 carry the coding of a body they don't send; the headers stay as they are.
+        if (res.body().empty()) {
+            return {};
+        }
+
+        auto coding = detail::trim(detail::header_value(res, http::field::content_encoding));
+        int window_bits;
+        if (boost::iequals(coding, "gzip") || boost::iequals(coding, "x-gzip")) {
+            window_bits = zlib::window_bits_for(zlib::Format::gzip);
+        } else if (boost::iequals(coding, "deflate")) {
+            window_bits = zlib::window_bits_for(has_zlib_header(res.body()) ? zlib::Format::zlib : zlib::Format::raw);
+        } else if (coding.empty() || boost::iequals(coding, "identity")) {
+            res.erase(http::field::content_encoding);
+            return {};
+        } else {
+            return std::unexpected("Unsupported Content-Encoding: " + std::string(coding));
+        }
+
+        std::string inflated;
+        try {
+            zlib::InflateStream inflater(window_bits);
+            inflater.write(as_bytes(res.body()), [&inflated](std::span<const std::byte> chunk) {
+                if (inflated.size() + chunk.size() > compression_options.max_inflated_size) {
+                    throw std::length_error("response body exceeds max_inflated_size");
+                }
+                inflated.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+            });
+            if (!inflater.ended()) {
+                return std::unexpected("Truncated " + std::string(coding) + " response body");
+            }
+        } catch (const std::exception& e) {
+            return std::unexpected("Failed to decompress response: " + std::string(e.what()));
+        }
+
+        responses_inflated.fetch_add(1, std::memory_order_relaxed);
+        inflated_bytes_in.fetch_add(res.body().size(), std::memory_order_relaxed);
+        inflated_bytes_out.fetch_add(inflated.size(), std::memory_order_relaxed);
+
+        res.body() = std::move(inflated);
+        res.erase(http::field::content_encoding);
+        res.content_length(res.body().size());
+        return {};
+    }
+
+} // namespace volcano::web
@@ -1,9 +1,14 @@
 #include "volcano/web/HttpClient.hpp"
+#include "volcano/web/BodyFormat.hpp"
+#include "volcano/web/Compression.hpp"
+#include "HeaderValue.hpp"
 
 #include "volcano/net/Base.hpp"
 #include "volcano/net/net.hpp"
 
 #include <boost/asio/as_tuple.hpp>
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/cancellation_signal.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/redirect_error.hpp>
@@ -11,12 +16,18 @@
 #include <boost/asio/use_awaitable.hpp>
 
 #include <algorithm>
+#include <array>
 #include <cctype>
+#include <list>
 #include <stdexcept>
 #include <system_error>
+#include <utility>
 
 namespace volcano::web {
 
+    HttpPoolOptions http_pool_options{.max_sessions = 64};
+    RequestCoalescingOptions request_coalescing_options;
+
     namespace {
         std::atomic<int64_t> session_id_seed{1};
 
@@ -58,6 +69,208 @@ namespace volcano::web {
         std::error_code to_std_error(const boost::system::error_code& ec) {
             return std::error_code(ec.value(), std::system_category());
         }
+
+        using RequestResult = std::expected<HttpResponse, std::string>;
+        using FlightChannel = boost::asio::experimental::concurrent_channel<
+            void(boost::system::error_code, std::shared_ptr<const RequestResult>)>;
+
+        std::atomic<std::uint64_t> coalescing_requests{0};
+        std::atomic<std::uint64_t> coalescing_fetched{0};
+        std::atomic<std::uint64_t> coalescing_joined{0};
+        std::atomic<std::uint64_t> coalescing_cache_hits{0};
+
+        // request headers that don't change what the backend answers, so they stay out of the key.
+        constexpr std::array neutral_request_headers{
+            http::field::host, http::field::user_agent, http::field::connection, http::field::keep_alive,
+            http::field::te, http::field::cache_control, http::field::pragma, http::field::content_length,
+        };
+
+        template <typename Fields>
+        bool has_directive(const Fields& fields, http::field name, std::string_view directive) {
+            return detail::header_value(fields, name).find(directive) != std::string_view::npos;
+        }
+
+        std::string coalescing_key(const HttpTarget& target, const HttpRequest& request) {
+            std::string key = target.scheme == HttpScheme::https ? "https " : "http ";
+            key += target.address.to_string();
+            key += ' ';
+            key += std::to_string(target.port);
+            auto append = [&key](std::string_view name, auto value) {
+                key += '\n';
+                key += name;
+                key += ':';
+                key.append(value.data(), value.size());
+            };
+            append("host", request[http::field::host]);
+            append("target", request.target());
+            for (const auto& name : request_coalescing_options.vary_headers) {
+                append(name, request[name]);
+            }
+            return key;
+        }
+
+        class RequestCoalescer {
+        public:
+            struct Flight {
+                std::vector<std::shared_ptr<FlightChannel>> waiters;
+            };
+
+            // Exactly one is set: a fresh cached response, a channel to wait on for
+            // another request's result, or a flight this caller now leads.
+            struct Joined {
+                std::optional<HttpResponse> cached;
+                std::shared_ptr<FlightChannel> waiter;
+                std::shared_ptr<Flight> flight;
+            };
+
+            Joined join(const std::string& key, bool use_cache) {
+                const auto now = std::chrono::steady_clock::now();
+                std::lock_guard lock(mutex_);
+                if (use_cache) {
+                    if (auto it = cache_index_.find(key); it != cache_index_.end()) {
+                        if (it->second->expires > now) {
+                            return Joined{.cached = it->second->response};
+                        }
+                        erase(it->second);
+                    }
+                }
+                if (auto it = flights_.find(key); it != flights_.end()) {
+                    auto waiter = std::make_shared<FlightChannel>(volcano::net::context(), 1);
+                    it->second->waiters.push_back(waiter);
+                    return Joined{.waiter = std::move(waiter)};
+                }
+                auto flight = std::make_shared<Flight>();
+                flights_.emplace(key, flight);
+                return Joined{.flight = std::move(flight)};
+            }
+
+            void finish(const std::string& key, const std::shared_ptr<Flight>& flight, std::shared_ptr<const RequestResult> result) {
+                std::vector<std::shared_ptr<FlightChannel>> waiters;
+                {
+                    std::lock_guard lock(mutex_);
+                    if (auto it = flights_.find(key); it != flights_.end() && it->second == flight) {
+                        flights_.erase(it);
+                    }
+                    waiters = std::move(flight->waiters);
+                    if (*result) {
+                        store(key, **result);
+                    }
+                }
+                for (auto& waiter : waiters) {
+                    waiter->try_send(boost::system::error_code{}, result);
+                }
+            }
+
+            std::pair<std::size_t, std::size_t> cache_size() {
+                std::lock_guard lock(mutex_);
+                return {cache_.size(), cache_bytes_};
+            }
+
+        private:
+            struct CacheEntry {
+                std::string key;
+                std::chrono::steady_clock::time_point expires;
+                HttpResponse response;
+            };
+
+            void store(const std::string& key, const HttpResponse& response) {
+                const auto& options = request_coalescing_options;
+                if (options.cache_ttl <= std::chrono::milliseconds::zero() || options.cache_max_entries == 0 ||
+                    response.result() != http::status::ok || response.body().size() > options.cache_max_bytes ||
+                    has_directive(response.base(), http::field::cache_control, "no-store") ||
+                    has_directive(response.base(), http::field::cache_control, "private")) {
+                    return;
+                }
+
+                const auto now = std::chrono::steady_clock::now();
+                if (auto it = cache_index_.find(key); it != cache_index_.end()) {
+                    erase(it->second);
+                }
+                // oldest first, so expired entries and the overflow both come off the front.
+                while (!cache_.empty() && (cache_.front().expires <= now || cache_.size() >= options.cache_max_entries ||
+                       cache_bytes_ + response.body().size() > options.cache_max_bytes)) {
+                    erase(cache_.begin());
+                }
+
+                cache_.push_back(CacheEntry{key, now + options.cache_ttl, response});
+                cache_index_[key] = std::prev(cache_.end());
+                cache_bytes_ += response.body().size();
+            }
+
+            void erase(std::list<CacheEntry>::iterator entry) {
+                cache_bytes_ -= entry->response.body().size();
+                cache_index_.erase(entry->key);
+                cache_.erase(entry);
+            }
+
+            std::mutex mutex_;
+            std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+            std::list<CacheEntry> cache_;
+            std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache_index_;
+            std::size_t cache_bytes_{0};
+        };
+
+        RequestCoalescer& coalescer() {
+            static RequestCoalescer instance;
+            return instance;
+        }
+
+        // Publishes the leader's result to the waiters; if the leader is cancelled or
+        // throws first, they get an error rather than waiting forever.
+        class FlightLeader {
+        public:
+            FlightLeader(std::string key, std::shared_ptr<RequestCoalescer::Flight> flight)
+                : key_(std::move(key)), flight_(std::move(flight)) {}
+
+            FlightLeader(const FlightLeader&) = delete;
+            FlightLeader& operator=(const FlightLeader&) = delete;
+
+            ~FlightLeader() {
+                if (flight_) {
+                    coalescer().finish(key_, flight_, std::make_shared<const RequestResult>(std::unexpected("coalesced request abandoned")));
+                }
+            }
+
+            void finish(const RequestResult& result) {
+                coalescer().finish(key_, std::exchange(flight_, {}), std::make_shared<const RequestResult>(result));
+            }
+
+        private:
+            std::string key_;
+            std::shared_ptr<RequestCoalescer::Flight> flight_;
+        };
+    }
+
+    // Every other header has to be one of vary_headers: a Cookie, Proxy-Authorization or
+    // custom header outside the key could change the answer, and sharing it would hand
+    // one caller's response to another.
+    bool request_is_coalescable(const HttpRequest& request) {
+        const auto& options = request_coalescing_options;
+        if (!options.enabled || request.method() != http::verb::get || !request.body().empty()) {
+            return false;
+        }
+        for (const auto& field : request) {
+            if (std::ranges::find(neutral_request_headers, field.name()) != neutral_request_headers.end()) {
+                continue;
+            }
+            const auto name = field.name_string();
+            if (std::ranges::none_of(options.vary_headers, [&](const std::string& vary) { return boost::beast::iequals(vary, name); })) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    RequestCoalescingStats request_coalescing_stats() {
+        auto [entries, bytes] = coalescer().cache_size();
+        return RequestCoalescingStats{
+            .requests = coalescing_requests.load(std::memory_order_relaxed),
+            .fetched = coalescing_fetched.load(std::memory_order_relaxed),
+            .coalesced = coalescing_joined.load(std::memory_order_relaxed),
+            .cache_hits = coalescing_cache_hits.load(std::memory_order_relaxed),
+            .cache_entries = entries,
+            .cache_bytes = bytes,
+        };
     }
 
     HttpSession::HttpSession(HttpTarget target, std::shared_ptr<boost::asio::ssl::context> tls_context)
@@ -146,6 +359,9 @@ namespace volcano::web {
         if (request.find(http::field::host) == request.end()) {
             request.set(http::field::host, target_.host());
         }
+        if (compression_options.client_accept_encoding && request.find(http::field::accept_encoding) == request.end()) {
+            request.set(http::field::accept_encoding, "gzip, deflate");
+        }
 
         buffer_.consume(buffer_.size());
         boost::system::error_code write_ec;
@@ -215,6 +431,10 @@ namespace volcano::web {
             close();
         }
 
+        if (auto inflated = decompress_response(response); !inflated) {
+            co_return std::unexpected(inflated.error());
+        }
+
         co_return response;
     }
 
@@ -223,52 +443,143 @@ namespace volcano::web {
           options_(std::move(options)),
           channel_(volcano::net::context(), static_cast<int>(options_.max_sessions)) {}
 
-    boost::asio::awaitable<std::shared_ptr<HttpSession>> HttpSessionPool::acquire() {
+    boost::asio::awaitable<std::shared_ptr<HttpSession>> HttpSessionPool::acquire(
+        std::optional<std::chrono::milliseconds> timeout) {
+        // an idle keep-alive session beats opening another connection. A null entry is a
+        // slot given back by a failed session, so it becomes a new one.
+        bool got_entry = false;
+        std::shared_ptr<HttpSession> idle;
+        channel_.try_receive([&](boost::system::error_code ec, std::shared_ptr<HttpSession> session) {
+            if (!ec) {
+                got_entry = true;
+                idle = std::move(session);
+            }
+        });
+        if (idle) {
+            reused_.fetch_add(1, std::memory_order_relaxed);
+            co_return idle;
+        }
+        if (got_entry) {
+            total_created_.fetch_add(1, std::memory_order_relaxed);
+            co_return std::make_shared<HttpSession>(target_, options_.tls_context);
+        }
+
         {
             std::lock_guard lock(mutex_);
             if (created_ < options_.max_sessions) {
                 ++created_;
+                total_created_.fetch_add(1, std::memory_order_relaxed);
                 co_return std::make_shared<HttpSession>(target_, options_.tls_context);
             }
+            ++waiting_;
         }
 
-        auto [ec, session] = co_await channel_.async_receive(boost::asio::as_tuple(boost::asio::use_awaitable));
+        waits_.fetch_add(1, std::memory_order_relaxed);
+        const auto started = std::chrono::steady_clock::now();
+
+        // the timer cancels the receive rather than racing it, so a session handed over
+        // just as the timeout fires is still received instead of dropped.
+        // shared with the timer handler, which can still be queued after this returns.
+        auto cancel = std::make_shared<boost::asio::cancellation_signal>();
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, timeout.value_or(options_.request_timeout));
+        timer.async_wait([cancel](boost::system::error_code ec) {
+            if (!ec) {
+                cancel->emit(boost::asio::cancellation_type::terminal);
+            }
+        });
+        auto [ec, session] = co_await channel_.async_receive(
+            boost::asio::bind_cancellation_slot(cancel->slot(), boost::asio::as_tuple(boost::asio::use_awaitable)));
+        timer.cancel();
+        {
+            std::lock_guard lock(mutex_);
+            --waiting_;
+        }
+        wait_micros_.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count(), std::memory_order_relaxed);
+
+        if (ec == boost::asio::error::operation_aborted) {
+            throw std::runtime_error("timed out waiting for an HTTP session");
+        }
         if (ec) {
             throw std::runtime_error("HTTP session pool closed: " + ec.message());
         }
+        if (!session) {
+            total_created_.fetch_add(1, std::memory_order_relaxed);
+            co_return std::make_shared<HttpSession>(target_, options_.tls_context);
+        }
+        reused_.fetch_add(1, std::memory_order_relaxed);
         co_return session;
     }
 
     void HttpSessionPool::release(const std::shared_ptr<HttpSession>& session) {
-        if (!session || !session->is_open()) {
-            std::lock_guard lock(mutex_);
+        const bool usable = session && session->is_open();
+        std::lock_guard lock(mutex_);
+        if (!usable && waiting_ == 0) {
             if (created_ > 0) {
                 --created_;
             }
             return;
         }
-        if (!channel_.try_send(boost::system::error_code{}, session)) {
-            session->close();
-            std::lock_guard lock(mutex_);
+        // a waiter takes the idle session, or the freed slot as a null entry.
+        if (!channel_.try_send(boost::system::error_code{}, usable ? session : nullptr)) {
+            if (session) {
+                session->close();
+            }
             if (created_ > 0) {
                 --created_;
             }
         }
     }
 
+    HttpPoolStats HttpSessionPool::stats() const {
+        return HttpPoolStats{
+            .open_sessions = created_.load(std::memory_order_relaxed),
+            .created = total_created_.load(std::memory_order_relaxed),
+            .reused = reused_.load(std::memory_order_relaxed),
+            .waits = waits_.load(std::memory_order_relaxed),
+            .wait_time = std::chrono::microseconds(wait_micros_.load(std::memory_order_relaxed)),
+        };
+    }
+
     std::shared_ptr<HttpSessionPool> HttpSessionPools::pool_for(const HttpTarget& target, HttpPoolOptions options) {
+        PoolKey key{target, options.tls_context};
         std::lock_guard lock(mutex_);
-        auto it = pools_.find(target);
+        auto it = pools_.find(key);
         if (it != pools_.end()) {
             if (auto existing = it->second.lock()) {
                 return existing;
             }
         }
         auto created = std::make_shared<HttpSessionPool>(target, std::move(options));
-        pools_[target] = created;
+        pools_[std::move(key)] = created;
         return created;
     }
 
+    HttpPoolStats HttpSessionPools::stats() {
+        HttpPoolStats total;
+        std::lock_guard lock(mutex_);
+        for (auto it = pools_.begin(); it != pools_.end();) {
+            auto pool = it->second.lock();
+            if (!pool) {
+                it = pools_.erase(it);
+                continue;
+            }
+            auto stats = pool->stats();
+            total.open_sessions += stats.open_sessions;
+            total.created += stats.created;
+            total.reused += stats.reused;
+            total.waits += stats.waits;
+            total.wait_time += stats.wait_time;
+            ++it;
+        }
+        return total;
+    }
+
+    HttpSessionPools& shared_session_pools() {
+        static HttpSessionPools pools;
+        return pools;
+    }
+
     HttpClient::HttpClient(std::shared_ptr<HttpSessionPool> pool) : pool_(std::move(pool)) {
         if (!pool_) {
             throw std::runtime_error("HttpClient requires a valid HttpSessionPool");
@@ -279,18 +590,77 @@ namespace volcano::web {
         : pool_(std::make_shared<HttpSessionPool>(std::move(target), std::move(options))) {}
 
     boost::asio::awaitable<std::expected<HttpResponse, std::string>> HttpClient::request(
+        HttpRequest request,
+        std::optional<std::chrono::milliseconds> timeout) {
+        if (!request_is_coalescable(request)) {
+            co_return co_await send(std::move(request), timeout);
+        }
+
+        coalescing_requests.fetch_add(1, std::memory_order_relaxed);
+        auto key = coalescing_key(target(), request);
+        // the caller can still insist on a fresh answer, though it may share one in flight.
+        auto joined = coalescer().join(key, !has_directive(request.base(), http::field::cache_control, "no-cache"));
+        if (joined.cached) {
+            coalescing_cache_hits.fetch_add(1, std::memory_order_relaxed);
+            co_return std::move(*joined.cached);
+        }
+        if (joined.waiter) {
+            using namespace boost::asio::experimental::awaitable_operators;
+            coalescing_joined.fetch_add(1, std::memory_order_relaxed);
+            // the leader runs on its own timeout; a waiter gives up on this caller's.
+            boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor,
+                timeout.value_or(pool_->options().request_timeout));
+            boost::system::error_code timer_ec;
+            auto waited = co_await (
+                joined.waiter->async_receive(boost::asio::as_tuple(boost::asio::use_awaitable)) ||
+                timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, timer_ec))
+            );
+            if (waited.index() == 1) {
+                co_return std::unexpected("timed out");
+            }
+            auto [ec, result] = std::get<0>(std::move(waited));
+            if (ec || !result) {
+                co_return std::unexpected("coalesced request failed");
+            }
+            co_return *result;
+        }
+
+        coalescing_fetched.fetch_add(1, std::memory_order_relaxed);
+        FlightLeader leader(std::move(key), std::move(joined.flight));
+        auto response = co_await send(std::move(request), timeout);
+        leader.finish(response);
+        co_return response;
+    }
+
+    boost::asio::awaitable<std::expected<HttpResponse, std::string>> HttpClient::send(
         HttpRequest request,
         std::optional<std::chrono::milliseconds> timeout) {
         auto effective_timeout = timeout.value_or(pool_->options().request_timeout);
 
         std::shared_ptr<HttpSession> session;
         try {
-            session = co_await pool_->acquire();
+            session = co_await pool_->acquire(effective_timeout);
         } catch (...) {
             co_return std::unexpected("resource unavailable, try again later");
         }
 
+        // binary bodies go out as-is unless this target is known to want JSON.
+        auto format = body_format_from_content_type(request[http::field::content_type]);
+        const bool binary_body = format && *format != BodyFormat::json;
+        if (binary_body && pool_->json_bodies_only()) {
+            transcode_to_json(request);
+        }
+        std::optional<HttpRequest> retry;
+        if (binary_body && !pool_->json_bodies_only()) {
+            retry = request;
+        }
+
         auto response = co_await session->request(std::move(request), effective_timeout);
+        if (response && retry && response->result() == http::status::unsupported_media_type &&
+            transcode_to_json(*retry)) {
+            pool_->set_json_bodies_only();
+            response = co_await session->request(std::move(*retry), effective_timeout);
+        }
         if (!response) {
             session->close();
         }
@@ -179,17 +179,18 @@ void Router::add_request_handler(std::string_view path, http::verb verb, Endpoin
     }
 }
 
-void Router::add_websocket_handler(std::string_view path, WebSocketHandler handler) {
-    add_websocket_handler(path, EndpointGuard{}, std::move(handler));
+void Router::add_websocket_handler(std::string_view path, WebSocketHandler handler, WebSocketOptions options) {
+    add_websocket_handler(path, EndpointGuard{}, std::move(handler), std::move(options));
 }
 
-void Router::add_websocket_handler(std::string_view path, EndpointGuard guard, WebSocketHandler handler) {
+void Router::add_websocket_handler(std::string_view path, EndpointGuard guard, WebSocketHandler handler,
+                                   WebSocketOptions options) {
     auto& router = get_or_create(path);
     if (router.websocket_handler_) {
         throw std::runtime_error("WebSocket handler already registered for this path.");
     }
 
-    router.websocket_handler_ = WebSocketEndpoint{std::move(guard), std::move(handler)};
+    router.websocket_handler_ = WebSocketEndpoint{std::move(guard), std::move(handler), std::move(options)};
 }
 
 void Router::register_parameter(std::string_view type, std::string_view pattern) {
@@ -1,5 +1,8 @@
 #include <volcano/web/web.hpp>
+#include <volcano/web/BodyFormat.hpp>
+#include <volcano/web/Compression.hpp>
 
+#include <algorithm>
 #include <optional>
 #include <vector>
 
@@ -11,6 +14,7 @@
 
 #include "volcano/net/Connection.hpp"
 #include "volcano/net/net.hpp"
+#include "volcano/zlib/Zlib.hpp"
 
 
 namespace volcano::web {
@@ -62,17 +66,58 @@ static HttpResponse make_response(const HttpRequest& req, HttpAnswer answer) {
 	res.set(http::field::content_type, answer.content_type);
 	res.keep_alive(req.keep_alive());
 	res.body() = std::move(answer.body);
+	compress_response(req, res);
 	res.prepare_payload();
 	return res;
 }
 
-std::expected<nlohmann::json, std::string> parse_json_body(HttpRequest& req) {
-	try {
-		auto json = nlohmann::json::parse(req.body());
-		return json;
-	} catch (const nlohmann::json::parse_error& e) {
-		return std::unexpected(std::string("Failed to parse JSON body: ") + e.what());
+boost::beast::websocket::permessage_deflate permessage_deflate_for(const WebSocketOptions& options) {
+	boost::beast::websocket::permessage_deflate pmd;
+	pmd.server_enable = options.deflate;
+	// zlib can't do an 8-bit window for raw deflate, so 9 is the floor.
+	pmd.server_max_window_bits = std::clamp(options.server_max_window_bits, 9, 15);
+	pmd.client_max_window_bits = std::clamp(options.client_max_window_bits, 9, 15);
+	pmd.server_no_context_takeover = options.server_no_context_takeover;
+	pmd.client_no_context_takeover = options.client_no_context_takeover;
+	pmd.compLevel = std::clamp(options.level, 0, 9);
+	pmd.memLevel = std::clamp(options.mem_level, 1, 9);
+
+	if (options.max_deflate_memory == 0) {
+		return pmd;
+	}
+
+	// our deflater plus the inflater for the client's messages.
+	auto estimate = [&pmd] {
+		volcano::zlib::DeflateOptions deflate{.window_bits = pmd.server_max_window_bits, .mem_level = pmd.memLevel};
+		return deflate.memory_estimate() + (std::size_t{1} << pmd.client_max_window_bits) + 7 * 1024;
+	};
+	while (estimate() > options.max_deflate_memory) {
+		// client_max_window_bits is left alone: a client that didn't offer it would be refused deflate.
+		if (pmd.server_max_window_bits > 9) {
+			--pmd.server_max_window_bits;
+		} else if (pmd.memLevel > 1) {
+			--pmd.memLevel;
+		} else {
+			break;
+		}
 	}
+	return pmd;
+}
+
+template<typename Message>
+static std::expected<nlohmann::json, std::string> parse_message_body(const Message& msg) {
+	// no or unknown Content-Type: assume JSON, as before negotiation existed.
+	auto content_type = msg[http::field::content_type];
+	auto format = body_format_from_content_type({content_type.data(), content_type.size()}).value_or(BodyFormat::json);
+	return decode_body(msg.body(), format);
+}
+
+std::expected<nlohmann::json, std::string> parse_json_body(HttpRequest& req) {
+	return parse_message_body(req);
+}
+
+std::expected<nlohmann::json, std::string> parse_json_body(const HttpResponse& res) {
+	return parse_message_body(res);
 }
 
 std::expected<nlohmann::json, HttpAnswer> authorize_bearer(HttpRequest& req, const volcano::jwt::JwtContext& jwt_ctx) {
@@ -193,6 +238,7 @@ volcano::net::ClientHandler make_router_handler(std::shared_ptr<Router> router)
 
 				WebSocketStream ws(std::move(stream));
 				ws.set_option(boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+				ws.set_option(permessage_deflate_for(ws_endpoint.options));
 				co_await ws.async_accept(req, boost::asio::use_awaitable);
 				co_await ws_endpoint.handler(ws, ctx);
 				co_return;
@@ -0,0 +1,307 @@
+// Compares MCCP2-style deflate profiles on a synthetic MUD output stream.
+// Every message is deflated with a sync flush, the same way the telnet writer does it.
+// Build with different VOLCANO_ZLIB_BACKEND / VOLCANO_WITH_LIBDEFLATE settings to
+// compare implementations; the backend in use is printed first.
+
+#include <volcano/zlib/Zlib.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+    std::atomic<std::size_t> allocations{0};
+}
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    std::vector<std::string> make_corpus(std::size_t messages) {
+        static const char* rooms[] = {
+            "The Temple Square",
+            "A Narrow Alley Behind the Smithy",
+            "The Eastern Gate of Midgaard",
+            "Inside the Dusty Library",
+        };
+        static const char* words[] = {
+            "the", "a", "stone", "ancient", "light", "shadows", "north", "south", "guard",
+            "flickers", "across", "walls", "you", "see", "here", "dragon", "sword", "gold",
+        };
+        static const char* colors[] = {"\x1b[0m", "\x1b[1;32m", "\x1b[0;36m", "\x1b[1;31m", "\x1b[38;5;208m"};
+
+        std::mt19937 rng(1280);
+        std::vector<std::string> out;
+        out.reserve(messages);
+
+        for (std::size_t i = 0; i < messages; ++i) {
+            std::string msg;
+            switch (rng() % 4) {
+                case 0: {
+                    msg += colors[1];
+                    msg += rooms[rng() % std::size(rooms)];
+                    msg += colors[0];
+                    msg += "\r\n";
+                    for (int w = 0; w < 60; ++w) {
+                        msg += words[rng() % std::size(words)];
+                        msg += (w % 12 == 11) ? "\r\n" : " ";
+                    }
+                    msg += "\r\n[Exits: north south east]\r\n";
+                    break;
+                }
+                case 1:
+                    msg += colors[3];
+                    msg += "You hit the dragon for ";
+                    msg += std::to_string(rng() % 200);
+                    msg += " damage!";
+                    msg += colors[0];
+                    msg += "\r\n";
+                    break;
+                case 2:
+                    msg += colors[4];
+                    msg += "[Chat] Someone: ";
+                    for (int w = 0; w < 8; ++w) {
+                        msg += words[rng() % std::size(words)];
+                        msg += ' ';
+                    }
+                    msg += colors[0];
+                    msg += "\r\n";
+                    break;
+                default:
+                    msg += colors[2];
+                    msg += "<" + std::to_string(rng() % 1000) + "hp " + std::to_string(rng() % 500) + "m> ";
+                    msg += colors[0];
+                    break;
+            }
+            out.push_back(std::move(msg));
+        }
+        return out;
+    }
+
+    double cpu_micros() {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) * 1e6 + static_cast<double>(ts.tv_nsec) / 1e3;
+    }
+
+    void run_profile(const std::vector<std::string>& corpus, const volcano::zlib::DeflateOptions& options) {
+        volcano::zlib::DeflateStream deflater(options);
+        std::size_t raw = 0;
+        std::size_t compressed = 0;
+        auto sink = [&](std::span<const std::byte> chunk) {
+            compressed += chunk.size();
+        };
+
+        const double started = cpu_micros();
+        for (const auto& msg : corpus) {
+            raw += msg.size();
+            deflater.write(std::as_bytes(std::span(msg)), sink, volcano::zlib::FlushMode::sync);
+        }
+        const double elapsed = cpu_micros() - started;
+
+        const double saved = static_cast<double>(raw) - static_cast<double>(compressed);
+        std::printf("%5d %6d %5d %8zu KB %10zu %10zu %7.3f %10.0f %10.2f %8.1f\n",
+                    options.level, options.window_bits, options.mem_level,
+                    options.memory_estimate() / 1024, raw, compressed,
+                    static_cast<double>(compressed) / static_cast<double>(raw),
+                    elapsed, saved / elapsed, static_cast<double>(raw) / elapsed);
+    }
+
+    // One-shot compression of whole responses, the way HTTP uses it: the corpus is
+    // cut into 16 KB bodies and each is compressed on its own.
+    void run_oneshot(const std::vector<std::string>& corpus) {
+        std::string joined;
+        for (const auto& msg : corpus) {
+            joined += msg;
+        }
+
+        std::printf("\noneshot level format        raw compressed   ratio     cpu_us     MB/s\n");
+        for (int level : {1, 6, 9}) {
+            for (auto format : {volcano::zlib::Format::gzip, volcano::zlib::Format::raw}) {
+                std::size_t compressed = 0;
+                std::vector<std::byte> out;
+                const double started = cpu_micros();
+                for (std::size_t pos = 0; pos < joined.size(); pos += 16 * 1024) {
+                    out.clear();
+                    auto body = std::string_view(joined).substr(pos, 16 * 1024);
+                    compressed += volcano::zlib::compress(std::as_bytes(std::span(body)), out, format, level);
+                }
+                const double elapsed = cpu_micros() - started;
+                std::printf("        %5d %-6s %10zu %10zu %7.3f %10.0f %8.1f\n", level,
+                            format == volcano::zlib::Format::gzip ? "gzip" : "raw", joined.size(), compressed,
+                            static_cast<double>(compressed) / static_cast<double>(joined.size()),
+                            elapsed, static_cast<double>(joined.size()) / elapsed);
+            }
+        }
+    }
+
+    // Minimal stand-in for beast::flat_buffer: prepare/commit/consume over one growing block.
+    class FlatBuffer {
+        public:
+        struct Region {
+            std::byte* ptr;
+            std::size_t len;
+            std::byte* data() const { return ptr; }
+            std::size_t size() const { return len; }
+        };
+
+        Region prepare(std::size_t n) {
+            if (end_ + n > storage_.size()) {
+                if (size() + n <= storage_.size()) {
+                    std::memmove(storage_.data(), storage_.data() + begin_, size());
+                } else {
+                    std::vector<std::byte> grown(std::max(2 * storage_.size(), size() + n));
+                    std::memcpy(grown.data(), storage_.data() + begin_, size());
+                    storage_ = std::move(grown);
+                }
+                end_ = size();
+                begin_ = 0;
+            }
+            return {storage_.data() + end_, n};
+        }
+
+        void commit(std::size_t n) { end_ += n; }
+        void consume(std::size_t n) { begin_ = std::min(begin_ + n, end_); }
+        std::size_t size() const { return end_ - begin_; }
+        std::string_view view() const {
+            return {reinterpret_cast<const char*>(storage_.data() + begin_), size()};
+        }
+
+        private:
+        std::vector<std::byte> storage_;
+        std::size_t begin_{0};
+        std::size_t end_{0};
+    };
+
+    // Replays a compressed stream through the telnet reader's MCCP3 path in 4 KB
+    // socket reads and counts heap allocations per MB of compressed input.
+    // "sink" is the old path (scratch buffer, append, copy every data run into a
+    // string), "direct" inflates into the parse buffer and hands out views.
+    void run_inflate(const std::vector<std::string>& corpus) {
+        std::vector<std::byte> compressed;
+        {
+            volcano::zlib::DeflateStream deflater(volcano::zlib::DeflateOptions{.level = 6});
+            for (const auto& msg : corpus) {
+                deflater.write(std::as_bytes(std::span(msg)), compressed, volcano::zlib::FlushMode::sync);
+            }
+        }
+
+        auto replay = [&](bool direct) {
+            std::size_t consumed_bytes = 0;
+            const std::size_t before = allocations.load();
+            {
+                volcano::zlib::InflateStream inflater;
+                FlatBuffer parse_buffer;
+                for (std::size_t pos = 0; pos < compressed.size(); pos += 4096) {
+                    auto input = std::span(compressed).subspan(pos, std::min<std::size_t>(4096, compressed.size() - pos));
+                    if (direct) {
+                        inflater.write_to(input, parse_buffer);
+                        consumed_bytes += parse_buffer.view().size();
+                    } else {
+                        inflater.write(input, [&](std::span<const std::byte> chunk) {
+                            auto region = parse_buffer.prepare(chunk.size());
+                            std::memcpy(region.data(), chunk.data(), chunk.size());
+                            parse_buffer.commit(chunk.size());
+                        });
+                        std::string copied(parse_buffer.view());
+                        consumed_bytes += copied.size();
+                    }
+                    parse_buffer.consume(parse_buffer.size());
+                }
+            }
+            const double mb = static_cast<double>(compressed.size()) / (1024.0 * 1024.0);
+            std::printf("%-8s %10zu %10zu %12.1f\n", direct ? "direct" : "sink",
+                        compressed.size(), consumed_bytes, static_cast<double>(allocations.load() - before) / mb);
+        };
+
+        std::printf("\ninflate  compressed    inflated  allocs/MB\n");
+        replay(false);
+        replay(true);
+    }
+
+    // The telnet writer's MCCP2 path: "sink" copies each deflated chunk into the
+    // outgoing buffer, "direct" deflates into it.
+    void run_deflate_to(const std::vector<std::string>& corpus) {
+        auto replay = [&](bool direct) {
+            std::size_t compressed = 0;
+            const std::size_t before = allocations.load();
+            const double started = cpu_micros();
+            {
+                volcano::zlib::DeflateStream deflater(volcano::zlib::DeflateOptions{.level = 6, .window_bits = 13, .mem_level = 6});
+                FlatBuffer out;
+                for (const auto& msg : corpus) {
+                    auto input = std::as_bytes(std::span(msg));
+                    if (direct) {
+                        deflater.write_to(input, out, volcano::zlib::FlushMode::sync);
+                    } else {
+                        deflater.write(input, [&](std::span<const std::byte> chunk) {
+                            auto region = out.prepare(chunk.size());
+                            std::memcpy(region.data(), chunk.data(), chunk.size());
+                            out.commit(chunk.size());
+                        }, volcano::zlib::FlushMode::sync);
+                    }
+                    compressed += out.size();
+                    out.consume(out.size());
+                }
+            }
+            const double elapsed = cpu_micros() - started;
+            std::printf("%-8s %10zu %10.0f %10zu\n", direct ? "direct" : "sink", compressed, elapsed,
+                        allocations.load() - before);
+        };
+
+        std::printf("\ndeflate  compressed     cpu_us     allocs\n");
+        replay(false);
+        replay(true);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t messages = 200000;
+    if (argc > 1) {
+        messages = std::stoul(argv[1]);
+    }
+    auto corpus = make_corpus(messages);
+
+    const volcano::zlib::DeflateOptions profiles[] = {
+        {.level = 9, .window_bits = 15, .mem_level = 8},
+        {.level = 6, .window_bits = 15, .mem_level = 8},
+        {.level = 6, .window_bits = 13, .mem_level = 6},
+        {.level = 4, .window_bits = 13, .mem_level = 6},
+        {.level = 1, .window_bits = 13, .mem_level = 6},
+        {.level = 6, .window_bits = 12, .mem_level = 5},
+        {.level = 1, .window_bits = 10, .mem_level = 4},
+    };
+
+    std::printf("backend: %s\n\n", volcano::zlib::backend_description().c_str());
+    std::printf("level window mem    memory        raw compressed   ratio     cpu_us saved/cpu_us    MB/s\n");
+    for (const auto& profile : profiles) {
+        run_profile(corpus, profile);
+    }
+
+    run_oneshot(corpus);
+    run_inflate(corpus);
+    run_deflate_to(corpus);
+    return 0;
+}
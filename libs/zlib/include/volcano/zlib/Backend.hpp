@@ -0,0 +1,65 @@
+#pragma once
+
+// The deflate implementation DeflateStream and InflateStream run on, picked at
+// build time with VOLCANO_ZLIB_BACKEND. Classic zlib is the default; zlib-ng is
+// used through its native zng_ API so it can sit in the same binary as a system
+// zlib that other dependencies link against.
+
+#include <cstdint>
+#include <string_view>
+
+#if defined(VOLCANO_ZLIB_NG)
+#include <zlib-ng.h>
+#else
+#include <zlib.h>
+#endif
+
+namespace volcano::zlib::backend {
+
+#if defined(VOLCANO_ZLIB_NG)
+
+using Stream = zng_stream;
+using Size = uint32_t;
+
+inline constexpr std::string_view name = "zlib-ng";
+
+inline const char* version() { return zlibng_version(); }
+
+inline int deflate_init(Stream* s, int level, int window_bits, int mem_level, int strategy) {
+    return zng_deflateInit2(s, level, Z_DEFLATED, window_bits, mem_level, strategy);
+}
+inline int deflate(Stream* s, int flush) { return zng_deflate(s, flush); }
+inline int deflate_params(Stream* s, int level, int strategy) { return zng_deflateParams(s, level, strategy); }
+inline int deflate_reset(Stream* s) { return zng_deflateReset(s); }
+inline int deflate_end(Stream* s) { return zng_deflateEnd(s); }
+
+inline int inflate_init(Stream* s, int window_bits) { return zng_inflateInit2(s, window_bits); }
+inline int inflate(Stream* s, int flush) { return zng_inflate(s, flush); }
+inline int inflate_reset(Stream* s) { return zng_inflateReset(s); }
+inline int inflate_end(Stream* s) { return zng_inflateEnd(s); }
+
+#else
+
+using Stream = z_stream;
+using Size = uInt;
+
+inline constexpr std::string_view name = "zlib";
+
+inline const char* version() { return zlibVersion(); }
+
+inline int deflate_init(Stream* s, int level, int window_bits, int mem_level, int strategy) {
+    return deflateInit2(s, level, Z_DEFLATED, window_bits, mem_level, strategy);
+}
+inline int deflate(Stream* s, int flush) { return ::deflate(s, flush); }
+inline int deflate_params(Stream* s, int level, int strategy) { return deflateParams(s, level, strategy); }
+inline int deflate_reset(Stream* s) { return deflateReset(s); }
+inline int deflate_end(Stream* s) { return deflateEnd(s); }
+
+inline int inflate_init(Stream* s, int window_bits) { return inflateInit2(s, window_bits); }
+inline int inflate(Stream* s, int flush) { return ::inflate(s, flush); }
+inline int inflate_reset(Stream* s) { return inflateReset(s); }
+inline int inflate_end(Stream* s) { return inflateEnd(s); }
+
+#endif
+
+} // namespace volcano::zlib::backend
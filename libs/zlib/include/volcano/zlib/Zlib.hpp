@@ -1,13 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <span>
 #include <stdexcept>
+#include <string>
 #include <utility>
 #include <vector>
 
-#include <zlib.h>
+#include <volcano/zlib/Backend.hpp>
 
 namespace volcano::zlib {
 
@@ -18,9 +21,92 @@ enum class FlushMode : int {
     finish = Z_FINISH
 };
 
+struct ZlibOptions {
+    // zlib's internal state (window, hash chains, pending buffer) comes from the
+    // per-thread size-class pool in volcano::util rather than malloc, so streams
+    // opened and closed by connection churn reuse the same blocks. Read when a
+    // stream is created.
+    bool pooled_allocations{true};
+};
+
+extern ZlibOptions zlib_options;
+
+// Parameters handed to deflateInit2. zlib's internal state costs roughly
+// (1 << (window_bits + 2)) + (1 << (mem_level + 9)) bytes, so the defaults
+// (15, 8) cost about 256 KB per stream.
+struct DeflateOptions {
+    int level{Z_DEFAULT_COMPRESSION};
+    int window_bits{MAX_WBITS};
+    int mem_level{8};
+    int strategy{Z_DEFAULT_STRATEGY};
+
+    [[nodiscard]] std::size_t memory_estimate() const {
+        return (std::size_t{1} << (window_bits + 2)) + (std::size_t{1} << (mem_level + 9)) + 6 * 1024;
+    }
+};
+
+// Framing around the deflate data: zlib (RFC 1950), gzip (RFC 1952) or raw deflate (RFC 1951).
+enum class Format {
+    zlib,
+    gzip,
+    raw
+};
+
+// window_bits value that selects format for the given window size.
+[[nodiscard]] constexpr int window_bits_for(Format format, int window_bits = MAX_WBITS) {
+    switch (format) {
+        case Format::gzip: return window_bits + 16;
+        case Format::raw: return -window_bits;
+        default: return window_bits;
+    }
+}
+
+// Compresses a complete buffer in one call and appends the result to out; returns
+// the bytes appended. Uses libdeflate when built with VOLCANO_WITH_LIBDEFLATE,
+// otherwise the streaming backend.
+std::size_t compress(std::span<const std::byte> input, std::vector<std::byte>& out,
+                     Format format = Format::zlib, int level = Z_DEFAULT_COMPRESSION);
+
+// Which implementations are compiled in, e.g. "zlib 1.3.1" or "zlib-ng 2.2.4, libdeflate 1.23".
+std::string backend_description();
+
+// Anything deflate/inflate output can be written into: beast::flat_buffer and friends.
+template <typename T>
+concept DynamicBuffer = requires(T& b, std::size_t n) {
+    b.prepare(n).data();
+    b.prepare(n).size();
+    b.commit(n);
+};
+
+template <typename T>
+concept ChunkSink = requires(T&& sink, std::span<const std::byte> chunk) { sink(chunk); };
+
+// Lets the sink-based calls share the DynamicBuffer code path: output lands in a
+// small stack buffer and is handed to the sink as each chunk is committed.
+template <typename Sink>
+class SinkBuffer {
+public:
+    explicit SinkBuffer(Sink& sink) : sink_(sink) {}
+
+    std::span<std::byte> prepare(std::size_t n) {
+        return {chunk_.data(), std::min(n, chunk_.size())};
+    }
+
+    void commit(std::size_t n) {
+        if (n > 0) {
+            sink_(std::span<const std::byte>(chunk_.data(), n));
+        }
+    }
+
+private:
+    Sink& sink_;
+    std::array<std::byte, 4096> chunk_;
+};
+
 class DeflateStream {
 public:
     explicit DeflateStream(int level = Z_DEFAULT_COMPRESSION);
+    explicit DeflateStream(const DeflateOptions& options);
     ~DeflateStream();
 
     DeflateStream(const DeflateStream&) = delete;
@@ -28,48 +114,114 @@ public:
     DeflateStream(DeflateStream&& other) noexcept;
     DeflateStream& operator=(DeflateStream&& other) noexcept;
 
+    // Starts a new stream. When window_bits and mem_level are unchanged the
+    // existing zlib state is rewound (deflateReset) instead of reallocated.
     void reset(int level = Z_DEFAULT_COMPRESSION);
+    void reset(const DeflateOptions& options);
+
+    [[nodiscard]] const DeflateOptions& options() const {
+        return options_;
+    }
+
+    // Change level/strategy mid-stream via deflateParams. Call this on a flush
+    // boundary; anything zlib still had pending is written to out first. Returns
+    // false, with the old parameters still in effect, if zlib had unflushed input.
+    template <DynamicBuffer Buffer>
+    bool set_params_to(int level, int strategy, Buffer& out, std::size_t chunk = 4096) {
+        if (ended_) {
+            throw std::runtime_error("DeflateStream used after finish().");
+        }
+        if (level == options_.level && strategy == options_.strategy) {
+            return true;
+        }
+
+        zstream_.next_in = Z_NULL;
+        zstream_.avail_in = 0;
+
+        int ret;
+        for (;;) {
+            auto region = out.prepare(chunk);
+            zstream_.next_out = reinterpret_cast<unsigned char*>(region.data());
+            zstream_.avail_out = static_cast<backend::Size>(region.size());
+
+            ret = backend::deflate_params(&zstream_, level, strategy);
+            out.commit(region.size() - zstream_.avail_out);
+            if (ret == Z_BUF_ERROR && zstream_.avail_out == 0) {
+                // pending output didn't fit; make room and try again.
+                continue;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                throw std::runtime_error("zlib deflateParams failed.");
+            }
+            break;
+        }
 
-    template <typename Sink>
-        requires requires(Sink&& sink, std::span<const std::byte> chunk) { sink(chunk); }
+        // Z_BUF_ERROR here means zlib kept the old parameters.
+        if (ret != Z_OK) {
+            return false;
+        }
+        options_.level = level;
+        options_.strategy = strategy;
+        return true;
+    }
+
+    template <ChunkSink Sink>
+    bool set_params(int level, int strategy, Sink&& sink) {
+        SinkBuffer<Sink> buffer(sink);
+        return set_params_to(level, strategy, buffer);
+    }
+
+    // Deflate straight into a dynamic buffer, growing it chunk bytes at a time.
+    template <DynamicBuffer Buffer>
+    std::size_t write_to(std::span<const std::byte> input, Buffer& out, FlushMode flush = FlushMode::none,
+                         std::size_t chunk = 4096) {
+        return process(input, static_cast<int>(flush), out, chunk);
+    }
+
+    template <DynamicBuffer Buffer>
+    std::size_t finish_to(Buffer& out, std::size_t chunk = 4096) {
+        return process({}, Z_FINISH, out, chunk);
+    }
+
+    template <ChunkSink Sink>
     std::size_t write(std::span<const std::byte> input, Sink&& sink, FlushMode flush = FlushMode::none) {
-        return process(input, static_cast<int>(flush), std::forward<Sink>(sink));
+        SinkBuffer<Sink> buffer(sink);
+        return write_to(input, buffer, flush);
     }
 
-    template <typename Sink>
-        requires requires(Sink&& sink, std::span<const std::byte> chunk) { sink(chunk); }
+    template <ChunkSink Sink>
     std::size_t finish(Sink&& sink) {
-        return process({}, Z_FINISH, std::forward<Sink>(sink));
+        SinkBuffer<Sink> buffer(sink);
+        return finish_to(buffer);
     }
 
     std::size_t write(std::span<const std::byte> input, std::vector<std::byte>& out, FlushMode flush = FlushMode::none);
     std::size_t finish(std::vector<std::byte>& out);
 
 private:
-    template <typename Sink>
-    std::size_t process(std::span<const std::byte> input, int flush, Sink&& sink) {
+    template <DynamicBuffer Buffer>
+    std::size_t process(std::span<const std::byte> input, int flush, Buffer& out, std::size_t chunk) {
         if (ended_) {
             throw std::runtime_error("DeflateStream used after finish().");
         }
 
-        zstream_.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(input.data()));
-        zstream_.avail_in = static_cast<uInt>(input.size());
+        zstream_.next_in = const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(input.data()));
+        zstream_.avail_in = static_cast<backend::Size>(input.size());
 
         std::size_t total_out = 0;
         while (zstream_.avail_in > 0 || flush != Z_NO_FLUSH) {
-            zstream_.next_out = reinterpret_cast<Bytef*>(buffer_.data());
-            zstream_.avail_out = static_cast<uInt>(buffer_.size());
+            auto region = out.prepare(chunk);
+            zstream_.next_out = reinterpret_cast<unsigned char*>(region.data());
+            zstream_.avail_out = static_cast<backend::Size>(region.size());
 
-            const int ret = deflate(&zstream_, flush);
+            const int ret = backend::deflate(&zstream_, flush);
             if (ret != Z_OK && ret != Z_STREAM_END) {
                 throw std::runtime_error("zlib deflate failed.");
             }
 
-            const std::size_t produced = buffer_.size() - zstream_.avail_out;
-            if (produced > 0) {
-                sink(std::span<const std::byte>(buffer_.data(), produced));
-                total_out += produced;
-            }
+            const std::size_t produced = region.size() - zstream_.avail_out;
+            out.commit(produced);
+            total_out += produced;
 
             if (ret == Z_STREAM_END) {
                 ended_ = true;
@@ -84,14 +236,18 @@ private:
         return total_out;
     }
 
-    z_stream zstream_{};
-    std::vector<std::byte> buffer_;
+    void init();
+
+    backend::Stream zstream_{};
+    DeflateOptions options_{};
     bool ended_{false};
 };
 
 class InflateStream {
 public:
-    InflateStream();
+    // window_bits as for inflateInit2; window_bits_for(Format::gzip) etc. picks the
+    // framing, and MAX_WBITS + 32 accepts either zlib or gzip.
+    explicit InflateStream(int window_bits = MAX_WBITS);
     ~InflateStream();
 
     InflateStream(const InflateStream&) = delete;
@@ -99,55 +255,54 @@ public:
     InflateStream(InflateStream&& other) noexcept;
     InflateStream& operator=(InflateStream&& other) noexcept;
 
+    // Starts a new stream, keeping the allocated window (inflateReset).
     void reset();
 
-    template <typename Sink>
-        requires requires(Sink&& sink, std::span<const std::byte> chunk) { sink(chunk); }
+    template <ChunkSink Sink>
     std::size_t write(std::span<const std::byte> input, Sink&& sink) {
-        return process(input, std::forward<Sink>(sink));
+        SinkBuffer<Sink> buffer(sink);
+        return write_to(input, buffer);
     }
 
-    template <typename Sink>
-        requires requires(Sink&& sink, std::span<const std::byte> chunk) { sink(chunk); }
+    template <ChunkSink Sink>
     std::size_t finish(Sink&& sink) {
-        return process({}, std::forward<Sink>(sink));
+        SinkBuffer<Sink> buffer(sink);
+        return write_to({}, buffer);
     }
 
     std::size_t write(std::span<const std::byte> input, std::vector<std::byte>& out);
 
-private:
-    template <typename Sink>
-    std::size_t process(std::span<const std::byte> input, Sink&& sink) {
+    // Inflate straight into a dynamic buffer, growing it chunk bytes at a time.
+    template <DynamicBuffer Buffer>
+    std::size_t write_to(std::span<const std::byte> input, Buffer& out, std::size_t chunk = 4096) {
         if (ended_) {
             throw std::runtime_error("InflateStream used after finish().");
         }
 
-        zstream_.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(input.data()));
-        zstream_.avail_in = static_cast<uInt>(input.size());
+        zstream_.next_in = const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(input.data()));
+        zstream_.avail_in = static_cast<backend::Size>(input.size());
 
         std::size_t total_out = 0;
         while (zstream_.avail_in > 0) {
-            zstream_.next_out = reinterpret_cast<Bytef*>(buffer_.data());
-            zstream_.avail_out = static_cast<uInt>(buffer_.size());
+            auto region = out.prepare(chunk);
+            zstream_.next_out = reinterpret_cast<unsigned char*>(region.data());
+            zstream_.avail_out = static_cast<backend::Size>(region.size());
 
-            const int ret = inflate(&zstream_, Z_NO_FLUSH);
-            if (ret == Z_STREAM_END) {
-                ended_ = true;
-            } else if (ret != Z_OK) {
+            const int ret = backend::inflate(&zstream_, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) {
                 throw std::runtime_error("zlib inflate failed.");
             }
 
-            const std::size_t produced = buffer_.size() - zstream_.avail_out;
-            if (produced > 0) {
-                sink(std::span<const std::byte>(buffer_.data(), produced));
-                total_out += produced;
-            }
+            const std::size_t produced = region.size() - zstream_.avail_out;
+            out.commit(produced);
+            total_out += produced;
 
             if (ret == Z_STREAM_END) {
+                ended_ = true;
                 break;
             }
 
-            if (zstream_.avail_in == 0 && zstream_.avail_out != 0) {
+            if (zstream_.avail_out != 0) {
                 break;
             }
         }
@@ -155,8 +310,15 @@ private:
         return total_out;
     }
 
-    z_stream zstream_{};
-    std::vector<std::byte> buffer_;
+    [[nodiscard]] bool ended() const {
+        return ended_;
+    }
+
+private:
+    void init();
+
+    backend::Stream zstream_{};
+    int window_bits_{MAX_WBITS};
     bool ended_{false};
 };
 
@@ -6,4 +6,5 @@
 #include <stdexcept>
 #include <vector>
 
-#include <zlib.h>
+// zlib.h or zlib-ng.h, whichever VOLCANO_ZLIB_BACKEND picked.
+#include <volcano/zlib/Backend.hpp>
@@ -0,0 +1,93 @@
+#include <volcano/zlib/Zlib.hpp>
+
+#if defined(VOLCANO_WITH_LIBDEFLATE)
+#include <libdeflate.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#endif
+
+namespace volcano::zlib {
+
+#if defined(VOLCANO_WITH_LIBDEFLATE)
+
+namespace {
+
+struct CompressorDeleter {
+    void operator()(libdeflate_compressor* compressor) const {
+        libdeflate_free_compressor(compressor);
+    }
+};
+
+// libdeflate compressors are not thread-safe and cost a few hundred KB each, so
+// every thread keeps one per level it has used.
+libdeflate_compressor* compressor_for(int level) {
+    thread_local std::array<std::unique_ptr<libdeflate_compressor, CompressorDeleter>, 13> compressors;
+    if (level == Z_DEFAULT_COMPRESSION) {
+        level = 6;
+    }
+    level = std::clamp(level, 0, 12);
+    auto& compressor = compressors[static_cast<std::size_t>(level)];
+    if (!compressor) {
+        compressor.reset(libdeflate_alloc_compressor(level));
+        if (!compressor) {
+            throw std::bad_alloc();
+        }
+    }
+    return compressor.get();
+}
+
+} // namespace
+
+std::size_t compress(std::span<const std::byte> input, std::vector<std::byte>& out, Format format, int level) {
+    auto* compressor = compressor_for(level);
+
+    std::size_t bound = 0;
+    switch (format) {
+        case Format::gzip: bound = libdeflate_gzip_compress_bound(compressor, input.size()); break;
+        case Format::raw: bound = libdeflate_deflate_compress_bound(compressor, input.size()); break;
+        default: bound = libdeflate_zlib_compress_bound(compressor, input.size()); break;
+    }
+
+    const std::size_t start = out.size();
+    out.resize(start + bound);
+    void* dest = out.data() + start;
+
+    std::size_t produced = 0;
+    switch (format) {
+        case Format::gzip: produced = libdeflate_gzip_compress(compressor, input.data(), input.size(), dest, bound); break;
+        case Format::raw: produced = libdeflate_deflate_compress(compressor, input.data(), input.size(), dest, bound); break;
+        default: produced = libdeflate_zlib_compress(compressor, input.data(), input.size(), dest, bound); break;
+    }
+    out.resize(start + produced);
+    if (produced == 0) {
+        throw std::runtime_error("libdeflate compression failed.");
+    }
+    return produced;
+}
+
+#else
+
+std::size_t compress(std::span<const std::byte> input, std::vector<std::byte>& out, Format format, int level) {
+    DeflateStream deflater(DeflateOptions{.level = level, .window_bits = window_bits_for(format)});
+    const std::size_t start = out.size();
+    deflater.write(input, out, FlushMode::none);
+    deflater.finish(out);
+    return out.size() - start;
+}
+
+#endif
+
+std::string backend_description() {
+    std::string out(backend::name);
+    out += ' ';
+    out += backend::version();
+#if defined(VOLCANO_WITH_LIBDEFLATE)
+    out += ", libdeflate ";
+    out += LIBDEFLATE_VERSION_STRING;
+#endif
+    return out;
+}
+
+} // namespace volcano::zlib
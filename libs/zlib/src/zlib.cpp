@@ -1,24 +1,100 @@
 #include <volcano/zlib/Zlib.hpp>
+#include <volcano/util/BufferPool.hpp>
+
+#include <new>
 
 namespace volcano::zlib {
 
-DeflateStream::DeflateStream(int level) : buffer_(16 * 1024) {
-    zstream_.zalloc = Z_NULL;
-    zstream_.zfree = Z_NULL;
-    zstream_.opaque = Z_NULL;
+ZlibOptions zlib_options;
+
+namespace {
+
+// zfree isn't told the size. A header in front of each block would push zlib's
+// power-of-two window and hash tables into the next size class, so each stream
+// instead keeps its few block sizes in a table reached through opaque.
+struct Allocations {
+    // zlib asks for at most five blocks per stream (state, window, prev, head, pending).
+    std::array<std::pair<void*, std::size_t>, 8> blocks{};
+};
+
+void* pool_zalloc(void* opaque, unsigned items, unsigned size) {
+    auto& blocks = static_cast<Allocations*>(opaque)->blocks;
+    auto slot = std::find_if(blocks.begin(), blocks.end(), [](const auto& block) { return block.first == nullptr; });
+    if (slot == blocks.end()) {
+        return Z_NULL;
+    }
+    const std::size_t bytes = std::size_t{items} * size;
+    try {
+        slot->first = volcano::util::pool_allocate(bytes);
+    } catch (...) {
+        // zlib is C; it reports Z_MEM_ERROR for a null block.
+        return Z_NULL;
+    }
+    slot->second = bytes;
+    return slot->first;
+}
+
+void pool_zfree(void* opaque, void* address) {
+    if (!address) {
+        return;
+    }
+    auto& blocks = static_cast<Allocations*>(opaque)->blocks;
+    auto slot = std::find_if(blocks.begin(), blocks.end(), [address](const auto& block) { return block.first == address; });
+    if (slot != blocks.end()) {
+        volcano::util::pool_deallocate(address, slot->second);
+        *slot = {};
+    }
+}
+
+void set_allocator(backend::Stream& stream) {
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    if (zlib_options.pooled_allocations) {
+        if (auto* table = new (std::nothrow) Allocations{}) {
+            stream.zalloc = pool_zalloc;
+            stream.zfree = pool_zfree;
+            stream.opaque = table;
+        }
+    }
+}
+
+// Call after deflateEnd/inflateEnd; the table moves with the stream, so a
+// moved-from stream (zfree cleared) has none.
+void release_allocator(backend::Stream& stream) {
+    if (stream.zfree == pool_zfree) {
+        delete static_cast<Allocations*>(stream.opaque);
+    }
+    stream.opaque = Z_NULL;
+}
+
+} // namespace
+
+DeflateStream::DeflateStream(int level) : DeflateStream(DeflateOptions{.level = level}) {
+}
 
-    const int ret = deflateInit(&zstream_, level);
+DeflateStream::DeflateStream(const DeflateOptions& options) : options_(options) {
+    init();
+}
+
+void DeflateStream::init() {
+    set_allocator(zstream_);
+
+    const int ret = backend::deflate_init(&zstream_, options_.level, options_.window_bits,
+                                          options_.mem_level, options_.strategy);
     if (ret != Z_OK) {
+        release_allocator(zstream_);
         throw std::runtime_error("zlib deflateInit failed.");
     }
 }
 
 DeflateStream::~DeflateStream() {
-    deflateEnd(&zstream_);
+    backend::deflate_end(&zstream_);
+    release_allocator(zstream_);
 }
 
 DeflateStream::DeflateStream(DeflateStream&& other) noexcept
-    : zstream_(other.zstream_), buffer_(std::move(other.buffer_)), ended_(other.ended_) {
+    : zstream_(other.zstream_), options_(other.options_), ended_(other.ended_) {
     other.zstream_.zalloc = Z_NULL;
     other.zstream_.zfree = Z_NULL;
     other.zstream_.opaque = Z_NULL;
@@ -34,9 +110,10 @@ DeflateStream& DeflateStream::operator=(DeflateStream&& other) noexcept {
         return *this;
     }
 
-    deflateEnd(&zstream_);
+    backend::deflate_end(&zstream_);
+    release_allocator(zstream_);
     zstream_ = other.zstream_;
-    buffer_ = std::move(other.buffer_);
+    options_ = other.options_;
     ended_ = other.ended_;
 
     other.zstream_.zalloc = Z_NULL;
@@ -51,14 +128,31 @@ DeflateStream& DeflateStream::operator=(DeflateStream&& other) noexcept {
 }
 
 void DeflateStream::reset(int level) {
-    deflateEnd(&zstream_);
-    zstream_ = {};
-    ended_ = false;
+    auto options = options_;
+    options.level = level;
+    reset(options);
+}
 
-    const int ret = deflateInit(&zstream_, level);
-    if (ret != Z_OK) {
-        throw std::runtime_error("zlib deflateInit failed.");
+void DeflateStream::reset(const DeflateOptions& options) {
+    // same window and hash sizes: rewind the stream and keep zlib's allocations.
+    if (options.window_bits == options_.window_bits && options.mem_level == options_.mem_level &&
+        backend::deflate_reset(&zstream_) == Z_OK) {
+        // nothing has been written since the reset, so this produces no output.
+        if ((options.level != options_.level || options.strategy != options_.strategy) &&
+            backend::deflate_params(&zstream_, options.level, options.strategy) != Z_OK) {
+            throw std::runtime_error("zlib deflateParams failed.");
+        }
+        options_ = options;
+        ended_ = false;
+        return;
     }
+
+    backend::deflate_end(&zstream_);
+    release_allocator(zstream_);
+    zstream_ = {};
+    options_ = options;
+    ended_ = false;
+    init();
 }
 
 std::size_t DeflateStream::write(std::span<const std::byte> input, std::vector<std::byte>& out, FlushMode flush) {
@@ -75,23 +169,27 @@ std::size_t DeflateStream::finish(std::vector<std::byte>& out) {
     return finish(sink);
 }
 
-InflateStream::InflateStream() : buffer_(16 * 1024) {
-    zstream_.zalloc = Z_NULL;
-    zstream_.zfree = Z_NULL;
-    zstream_.opaque = Z_NULL;
+InflateStream::InflateStream(int window_bits) : window_bits_(window_bits) {
+    init();
+}
+
+void InflateStream::init() {
+    set_allocator(zstream_);
 
-    const int ret = inflateInit(&zstream_);
+    const int ret = backend::inflate_init(&zstream_, window_bits_);
     if (ret != Z_OK) {
+        release_allocator(zstream_);
         throw std::runtime_error("zlib inflateInit failed.");
     }
 }
 
 InflateStream::~InflateStream() {
-    inflateEnd(&zstream_);
+    backend::inflate_end(&zstream_);
+    release_allocator(zstream_);
 }
 
 InflateStream::InflateStream(InflateStream&& other) noexcept
-    : zstream_(other.zstream_), buffer_(std::move(other.buffer_)), ended_(other.ended_) {
+    : zstream_(other.zstream_), window_bits_(other.window_bits_), ended_(other.ended_) {
     other.zstream_.zalloc = Z_NULL;
     other.zstream_.zfree = Z_NULL;
     other.zstream_.opaque = Z_NULL;
@@ -107,9 +205,10 @@ InflateStream& InflateStream::operator=(InflateStream&& other) noexcept {
         return *this;
     }
 
-    inflateEnd(&zstream_);
+    backend::inflate_end(&zstream_);
+    release_allocator(zstream_);
     zstream_ = other.zstream_;
-    buffer_ = std::move(other.buffer_);
+    window_bits_ = other.window_bits_;
     ended_ = other.ended_;
 
     other.zstream_.zalloc = Z_NULL;
@@ -124,14 +223,16 @@ InflateStream& InflateStream::operator=(InflateStream&& other) noexcept {
 }
 
 void InflateStream::reset() {
-    inflateEnd(&zstream_);
-    zstream_ = {};
     ended_ = false;
-
-    const int ret = inflateInit(&zstream_);
-    if (ret != Z_OK) {
-        throw std::runtime_error("zlib inflateInit failed.");
+    if (backend::inflate_reset(&zstream_) == Z_OK) {
+        return;
     }
+
+    // a moved-from stream has no state left to rewind.
+    backend::inflate_end(&zstream_);
+    release_allocator(zstream_);
+    zstream_ = {};
+    init();
 }
 
 std::size_t InflateStream::write(std::span<const std::byte> input, std::vector<std::byte>& out) {